@@ -47,6 +47,7 @@ FastBDT_library.GetNumberOfFlatnessFeatures.restypes = ctypes.c_uint
 
 FastBDT_library.SetBinning.argtypes = [ctypes.c_void_p, c_uint_p, ctypes.c_uint]
 FastBDT_library.SetPurityTransformation.argtypes = [ctypes.c_void_p, c_uint_p, ctypes.c_uint]
+FastBDT_library.SetBinningStrategy.argtypes = [ctypes.c_void_p, c_uint_p, ctypes.c_uint]
 
 FastBDT_library.SetDepth.argtypes = [ctypes.c_void_p, ctypes.c_uint]
 FastBDT_library.GetDepth.argtypes = [ctypes.c_void_p]
@@ -60,6 +61,38 @@ FastBDT_library.SetSPlot.argtypes = [ctypes.c_void_p, ctypes.c_bool]
 FastBDT_library.GetSPlot.argtypes = [ctypes.c_void_p]
 FastBDT_library.GetSPlot.restypes = ctypes.c_bool
 
+FastBDT_library.SetNThreads.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+FastBDT_library.GetNThreads.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetNThreads.restypes = ctypes.c_uint
+
+FastBDT_library.SetColumnMajor.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+FastBDT_library.GetColumnMajor.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetColumnMajor.restypes = ctypes.c_bool
+
+FastBDT_library.SetHistogramTileSize.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+FastBDT_library.GetHistogramTileSize.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetHistogramTileSize.restypes = ctypes.c_uint
+
+FastBDT_library.SetSeed.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+FastBDT_library.GetSeed.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetSeed.restypes = ctypes.c_uint
+
+FastBDT_library.SetStratifiedSubsample.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+FastBDT_library.GetStratifiedSubsample.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetStratifiedSubsample.restypes = ctypes.c_bool
+
+FastBDT_library.SetGOSSTopFraction.argtypes = [ctypes.c_void_p, ctypes.c_double]
+FastBDT_library.GetGOSSTopFraction.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetGOSSTopFraction.restypes = ctypes.c_double
+
+FastBDT_library.SetAggregateDuplicates.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+FastBDT_library.GetAggregateDuplicates.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetAggregateDuplicates.restypes = ctypes.c_bool
+
+FastBDT_library.SetMaxLeaves.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+FastBDT_library.GetMaxLeaves.argtypes = [ctypes.c_void_p]
+FastBDT_library.GetMaxLeaves.restypes = ctypes.c_uint
+
 
 FastBDT_library.GetVariableRanking.argtypes = [ctypes.c_void_p]
 FastBDT_library.GetVariableRanking.restype = ctypes.c_void_p
@@ -96,7 +129,7 @@ def calculate_roc_auc(p, t, w=None):
 
 
 class Classifier(object):
-    def __init__(self, binning=[], nTrees=100, depth=3, shrinkage=0.1, subsample=0.5, transform2probability=True, purityTransformation=[], sPlot=False, flatnessLoss=-1.0, numberOfFlatnessFeatures=0):
+    def __init__(self, binning=[], nTrees=100, depth=3, shrinkage=0.1, subsample=0.5, transform2probability=True, purityTransformation=[], sPlot=False, flatnessLoss=-1.0, numberOfFlatnessFeatures=0, nThreads=1, columnMajor=False, histogramTileSize=0, seed=0, stratifiedSubsample=False, gossTopFraction=0.0, aggregateDuplicates=False, binningStrategy=[], maxLeaves=0):
         """
         @param binning list of numbers with the power N used for each feature binning e.g. 8 means 2^8 bins
         @param nTrees number of trees
@@ -107,6 +140,15 @@ class Classifier(object):
         @param sPlot special treatment of sPlot weights are used
         @param flatnessLoss if bigger than 0 a flatness boost against all flatnessFeatures
         @param numberOfFlatnessFeatures the number of flatness features, it is assumed that the last N features are the flatness features
+        @param nThreads number of threads used during the training, the result does not depend on it
+        @param columnMajor store the binned training data feature by feature instead of event by event, the result does not depend on it
+        @param histogramTileSize size in bytes of the feature tiles used to fill the histograms, 0 chooses it automatically, the result does not depend on it
+        @param seed seed of the random numbers used for the subsampling, 0 draws a new seed for every fit
+        @param stratifiedSubsample draw exactly the fraction subsample of the signal and of the background events
+        @param gossTopFraction if larger than 0 gradient-based one-side sampling is used, this fraction of the events with the largest boosting weights is always used and the fraction subsample of the remaining events
+        @param aggregateDuplicates merge events of the same class with identical bins into one event with the sum of their weights before the training
+        @param binningStrategy list of numbers with the binning strategy used for each feature: 0 quantiles, 1 weighted quantiles, 2 equidistant bins
+        @param maxLeaves if larger than 0 the trees are grown best-first up to this number of leaves, with at most depth layers
         """
         self.binning = binning
         self.nTrees = nTrees
@@ -118,6 +160,15 @@ class Classifier(object):
         self.sPlot = sPlot
         self.flatnessLoss = flatnessLoss
         self.numberOfFlatnessFeatures = numberOfFlatnessFeatures
+        self.nThreads = nThreads
+        self.columnMajor = columnMajor
+        self.histogramTileSize = histogramTileSize
+        self.seed = seed
+        self.stratifiedSubsample = stratifiedSubsample
+        self.gossTopFraction = gossTopFraction
+        self.aggregateDuplicates = aggregateDuplicates
+        self.binningStrategy = binningStrategy
+        self.maxLeaves = maxLeaves
         self.forest = self.create_forest()
 
     def create_forest(self):
@@ -131,7 +182,16 @@ class Classifier(object):
         FastBDT_library.SetFlatnessLoss(forest, float(self.flatnessLoss))
         FastBDT_library.SetTransform2Probability(forest, bool(self.transform2probability))
         FastBDT_library.SetSPlot(forest, bool(self.sPlot))
+        FastBDT_library.SetNThreads(forest, int(self.nThreads))
+        FastBDT_library.SetColumnMajor(forest, bool(self.columnMajor))
+        FastBDT_library.SetHistogramTileSize(forest, int(self.histogramTileSize))
+        FastBDT_library.SetSeed(forest, int(self.seed))
+        FastBDT_library.SetStratifiedSubsample(forest, bool(self.stratifiedSubsample))
+        FastBDT_library.SetGOSSTopFraction(forest, float(self.gossTopFraction))
+        FastBDT_library.SetAggregateDuplicates(forest, bool(self.aggregateDuplicates))
+        FastBDT_library.SetMaxLeaves(forest, int(self.maxLeaves))
         FastBDT_library.SetPurityTransformation(forest, np.array(self.purityTransformation).ctypes.data_as(c_uint_p), int(len(self.purityTransformation)))
+        FastBDT_library.SetBinningStrategy(forest, np.array(self.binningStrategy, dtype=np.uint32).ctypes.data_as(c_uint_p), int(len(self.binningStrategy)))
         return forest
 
     def fit(self, X, y, weights=None):
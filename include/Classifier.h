@@ -25,7 +25,9 @@ class Classifier {
 
       Classifier(std::istream& stream) {
 
-        stream >> m_version;
+        // The classifier is read in the format of the stored version, but always written in the current version
+        unsigned int version;
+        stream >> version;
         stream >> m_nTrees;
         stream >> m_depth;
         stream >> m_binning;
@@ -35,14 +37,23 @@ class Classifier {
         stream >> m_flatnessLoss;
         stream >> m_purityTransformation;
         stream >> m_transform2probability;
+        if(version >= 2) {
+          std::vector<unsigned int> binningStrategy;
+          stream >> binningStrategy;
+          m_binningStrategy.assign(binningStrategy.size(), BinningStrategy::Quantile);
+          for(unsigned int iFeature = 0; iFeature < binningStrategy.size(); ++iFeature)
+            m_binningStrategy[iFeature] = static_cast<BinningStrategy>(binningStrategy[iFeature]);
+        }
         stream >> m_featureBinning;
+        for(unsigned int iFeature = 0; iFeature < m_featureBinning.size() and iFeature < m_binningStrategy.size(); ++iFeature)
+          m_featureBinning[iFeature].SetEquidistant(m_binningStrategy[iFeature] == BinningStrategy::Equidistant);
         stream >> m_purityBinning;
         stream >> m_numberOfFeatures;
         stream >> m_numberOfFinalFeatures;
         stream >> m_numberOfFlatnessFeatures;
         stream >> m_can_use_fast_forest;
-        m_fast_forest = readForestFromStream<float>(stream);
-        m_binned_forest = readForestFromStream<unsigned int>(stream);
+        m_fast_forest = readForestFromStream<float>(stream, version >= 3);
+        m_binned_forest = readForestFromStream<unsigned int>(stream, version >= 3);
 
       }
 
@@ -73,12 +84,62 @@ class Classifier {
       bool GetSPlot() const { return m_sPlot; }
       void SetSPlot(bool sPlot) { m_sPlot = sPlot; }
       
+      unsigned int GetNThreads() const { return m_nThreads; }
+      void SetNThreads(unsigned int nThreads) { m_nThreads = nThreads; }
+      
+      bool GetColumnMajor() const { return m_columnMajor; }
+      void SetColumnMajor(bool columnMajor) { m_columnMajor = columnMajor; }
+      
+      /**
+       * The seed of the random numbers used for the subsampling, the same seed gives the same forest independent of the number of threads.
+       * If the seed is 0, a seed is drawn with std::rand for every fit.
+       */
+      unsigned int GetSeed() const { return m_seed; }
+      void SetSeed(unsigned int seed) { m_seed = seed; }
+      
+      /**
+       * If true the subsample contains exactly the fraction given by subsample of the signal and of the background events
+       */
+      bool GetStratifiedSubsample() const { return m_stratifiedSubsample; }
+      void SetStratifiedSubsample(bool stratifiedSubsample) { m_stratifiedSubsample = stratifiedSubsample; }
+      
+      /**
+       * If larger than 0, gradient-based one-side sampling is used: this fraction of the events with the largest boosting weights
+       * is always used, and the fraction given by subsample of the remaining events, see ForestBuilder
+       */
+      double GetGOSSTopFraction() const { return m_gossTopFraction; }
+      void SetGOSSTopFraction(double gossTopFraction) { m_gossTopFraction = gossTopFraction; }
+      
+      /**
+       * If true, events of the same class with identical bins are merged into a single event with the sum of their weights before the training.
+       * The subsampling then draws merged events. Cannot be combined with sPlot.
+       */
+      bool GetAggregateDuplicates() const { return m_aggregateDuplicates; }
+      void SetAggregateDuplicates(bool aggregateDuplicates) { m_aggregateDuplicates = aggregateDuplicates; }
+      
+      /**
+       * If larger than 0, the trees are grown best-first: the leaf with the largest gain is split until a tree has this number of leaves.
+       * The depth of the trees is still bounded by depth. If 0, complete trees are trained.
+       */
+      unsigned int GetMaxLeaves() const { return m_maxLeaves; }
+      void SetMaxLeaves(unsigned int maxLeaves) { m_maxLeaves = maxLeaves; }
+      
+      unsigned int GetHistogramTileSize() const { return m_histogramTileSize; }
+      void SetHistogramTileSize(unsigned int histogramTileSize) { m_histogramTileSize = histogramTileSize; }
+      
       bool GetTransform2Probability() const { return m_transform2probability; }
       void SetTransform2Probability(bool transform2probability) { m_transform2probability = transform2probability; }
       
       std::vector<unsigned int> GetBinning() const { return m_binning; }
       void SetBinning(std::vector<unsigned int> binning) { m_binning = binning; }
 
+      /**
+       * Strategy used to determine the bin boundaries of every feature and spectator, by default the quantiles are used.
+       * The strategy is stored with the classifier, so the fast lookup of equidistant bins is also used for the inference.
+       */
+      std::vector<BinningStrategy> GetBinningStrategy() const { return m_binningStrategy; }
+      void SetBinningStrategy(std::vector<BinningStrategy> binningStrategy) { m_binningStrategy = binningStrategy; }
+
       std::vector<bool> GetPurityTransformation() const { return m_purityTransformation; }
       void SetPurityTransformation(std::vector<bool> purityTransformation) { m_purityTransformation = purityTransformation; }
 
@@ -94,11 +155,21 @@ class Classifier {
       std::map<unsigned int, double> GetIndividualVariableRanking(const std::vector<float> &X) const;
 
       std::map<unsigned int, unsigned int> GetFeatureMapping() const;
+
+      /**
+       * Returns the binning of every feature calculated by the last fit, the binnings of the flatness features are not kept
+       */
+      const std::vector<FeatureBinning<float>>& GetFeatureBinning() const { return m_featureBinning; }
   
       std::map<unsigned int, double> MapRankingToOriginalFeatures(std::map<unsigned int, double> ranking) const;
 
+      /**
+       * Returns the loss of the out-of-bag events after every tree of the last fit, see ForestBuilder::GetOutOfBagLoss
+       */
+      const std::vector<double>& GetOutOfBagLoss() const { return m_outOfBagLoss; }
+
   private:
-    unsigned int m_version = 1;
+    unsigned int m_version = 3;
     unsigned int m_nTrees = 100;
     unsigned int m_depth = 3;
     std::vector<unsigned int> m_binning;
@@ -107,12 +178,22 @@ class Classifier {
     bool m_sPlot = true;
     double m_flatnessLoss = -1;
     std::vector<bool> m_purityTransformation;
+    std::vector<BinningStrategy> m_binningStrategy;
     unsigned int m_numberOfFlatnessFeatures = 0;
     bool m_transform2probability = true;
+    unsigned int m_nThreads = 1;
+    bool m_columnMajor = false;
+    unsigned int m_histogramTileSize = 0;
+    unsigned int m_seed = 0;
+    bool m_stratifiedSubsample = false;
+    double m_gossTopFraction = 0.0;
+    bool m_aggregateDuplicates = false;
+    unsigned int m_maxLeaves = 0;
     unsigned int m_numberOfFeatures = 0;
     unsigned int m_numberOfFinalFeatures = 0;
     std::vector<FeatureBinning<float>> m_featureBinning;
     std::vector<PurityTransformation> m_purityBinning;
+    std::vector<double> m_outOfBagLoss;
 
     bool m_can_use_fast_forest = true;
     Forest<float> m_fast_forest;
@@ -18,6 +18,7 @@ extern "C" {
 
     void SetBinning(void *ptr, unsigned int* binning, unsigned int size);
     void SetPurityTransformation(void *ptr, bool* purityTransformation, unsigned int size);
+    void SetBinningStrategy(void *ptr, unsigned int* binningStrategy, unsigned int size);
     
     void SetNTrees(void *ptr, unsigned int nTrees);
     unsigned int GetNTrees(void *ptr);
@@ -43,6 +44,30 @@ extern "C" {
     void SetSPlot(void *ptr, bool sPlot);
     bool GetSPlot(void *ptr);
     
+    void SetNThreads(void *ptr, unsigned int nThreads);
+    unsigned int GetNThreads(void *ptr);
+    
+    void SetColumnMajor(void *ptr, bool columnMajor);
+    bool GetColumnMajor(void *ptr);
+    
+    void SetHistogramTileSize(void *ptr, unsigned int histogramTileSize);
+    unsigned int GetHistogramTileSize(void *ptr);
+    
+    void SetSeed(void *ptr, unsigned int seed);
+    unsigned int GetSeed(void *ptr);
+    
+    void SetStratifiedSubsample(void *ptr, bool stratifiedSubsample);
+    bool GetStratifiedSubsample(void *ptr);
+    
+    void SetGOSSTopFraction(void *ptr, double gossTopFraction);
+    double GetGOSSTopFraction(void *ptr);
+    
+    void SetAggregateDuplicates(void *ptr, bool aggregateDuplicates);
+    bool GetAggregateDuplicates(void *ptr);
+    
+    void SetMaxLeaves(void *ptr, unsigned int maxLeaves);
+    unsigned int GetMaxLeaves(void *ptr);
+    
     void Delete(void *ptr);
     
     void Fit(void *ptr, float *data_ptr, float *weight_ptr, bool *target_ptr, unsigned int nEvents, unsigned int nFeatures);
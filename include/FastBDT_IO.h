@@ -132,6 +132,10 @@ namespace FastBDT {
      stream << tree.GetBoostWeights() << std::endl;
      stream << tree.GetPurities() << std::endl;
      stream << tree.GetNEntries() << std::endl;
+     stream << tree.IsCompact() << std::endl;
+     if( tree.IsCompact() ) {
+        stream << tree.GetChildren() << std::endl;
+     }
      return stream;
   }
   
@@ -139,10 +143,11 @@ namespace FastBDT {
   /**
    * This function reads a Tree from an std::istream
    * @param stream an std::istream reference
+   * @param withLayout if false the tree was written without its layout flag (Classifier version < 3), and is complete
    * @preturn tree containing read data
    */
   template<class T>
-  Tree<T> readTreeFromStream(std::istream& stream) {
+  Tree<T> readTreeFromStream(std::istream& stream, bool withLayout = true) {
       unsigned int size;
       stream >> size;
       std::vector<Cut<T>> cuts(size);
@@ -158,8 +163,18 @@ namespace FastBDT {
       
 			std::vector<Weight> nEntries;
       stream >> nEntries;
+
+      bool compact = false;
+      if( withLayout ) {
+        stream >> compact;
+      }
+
+      std::vector<unsigned int> children;
+      if( compact ) {
+        stream >> children;
+      }
       
-      return Tree<T>(cuts, nEntries, purities, boost_weights);
+      return Tree<T>(cuts, nEntries, purities, boost_weights, children);
 
   }
   
@@ -186,10 +201,11 @@ namespace FastBDT {
   /**
    * This function reads a Forest from an std::istream
    * @param stream an std::istream reference
+   * @param withLayout if false the trees were written without their layout flag, see readTreeFromStream
    * @preturn forest containing read data
    */
   template<class T>
-  Forest<T> readForestFromStream(std::istream& stream) {
+  Forest<T> readForestFromStream(std::istream& stream, bool withLayout = true) {
       double F0;
       stream >> F0;
 
@@ -205,7 +221,7 @@ namespace FastBDT {
       stream >> size;
 
       for(unsigned int i = 0; i < size; ++i) {
-        forest.AddTree(readTreeFromStream<T>(stream));
+        forest.AddTree(readTreeFromStream<T>(stream, withLayout));
       }
 
       return forest;
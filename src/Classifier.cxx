@@ -7,9 +7,27 @@
 
 #include "Classifier.h"
 #include <iostream>
+#include <cstdlib>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
 
 namespace FastBDT {
 
+  /**
+   * Hash of the bins of an event, used to find events with identical bins
+   */
+  struct BinsHash {
+    size_t operator()(const std::vector<unsigned int> &bins) const {
+      uint64_t hash = 14695981039346656037ull;
+      for(auto &bin : bins) {
+        hash ^= bin;
+        hash *= 1099511628211ull;
+      }
+      return static_cast<size_t>(hash);
+    }
+  };
+
   void Classifier::fit(const std::vector<std::vector<float>> &X, const std::vector<bool> &y, const std::vector<Weight> &w) {
 
     if(static_cast<int>(X.size()) - static_cast<int>(m_numberOfFlatnessFeatures) <= 0) {
@@ -39,6 +57,18 @@ namespace FastBDT {
       throw std::runtime_error("Number of ordinary features must be equal to the number of provided purityTransformation flags.");
     }
 
+    if(m_binningStrategy.size() == 0) {
+      m_binningStrategy.resize(m_binning.size(), BinningStrategy::Quantile);
+    }
+
+    if(m_binningStrategy.size() != m_binning.size()) {
+      throw std::runtime_error("Number of features must be equal to the number of provided binning strategies");
+    }
+
+    for(auto &strategy : m_binningStrategy)
+      if(strategy != BinningStrategy::Quantile and strategy != BinningStrategy::Weighted and strategy != BinningStrategy::Equidistant)
+        throw std::runtime_error("Unknown binning strategy");
+
     unsigned int numberOfEvents = X[0].size();
     if(numberOfEvents == 0) {
       throw std::runtime_error("FastBDT requires at least one event");
@@ -52,30 +82,58 @@ namespace FastBDT {
       throw std::runtime_error("Number of data-points X doesn't match the numbers of weights w");
     }
 
+    // The binnings of the features and spectators are independent of each other, so they are calculated in parallel
+    const std::vector<unsigned int> levels = m_binning;
+    const unsigned int nBinnings = m_numberOfFeatures + m_numberOfFlatnessFeatures;
+    std::vector<PurityTransformation> purityBinning(m_numberOfFeatures);
+    m_featureBinning.resize(nBinnings);
+    std::atomic<unsigned int> nextFeature(0);
+    RunInParallel(std::min(m_nThreads, nBinnings), [&](unsigned int) {
+      for(unsigned int iFeature = nextFeature++; iFeature < nBinnings; iFeature = nextFeature++) {
+        auto feature = X[iFeature];
+        if(m_binningStrategy[iFeature] == BinningStrategy::Weighted) {
+          auto weights = w;
+          m_featureBinning[iFeature] = WeightedFeatureBinning<float>(levels[iFeature], feature, weights);
+        } else if(m_binningStrategy[iFeature] == BinningStrategy::Equidistant) {
+          m_featureBinning[iFeature] = EquidistantFeatureBinning<float>(levels[iFeature], feature);
+        } else {
+          m_featureBinning[iFeature] = FeatureBinning<float>(levels[iFeature], feature);
+        }
+        if(iFeature < m_numberOfFeatures and m_purityTransformation[iFeature]) {
+          std::vector<unsigned int> bins(numberOfEvents);
+          for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+            bins[iEvent] = m_featureBinning[iFeature].ValueToBin(X[iFeature][iEvent]);
+          }
+          purityBinning[iFeature] = PurityTransformation(levels[iFeature], bins, w, y);
+        }
+      }
+    });
+
+    // Every purity transformed feature is an additional final feature with the same binning, placed right after the feature
     m_numberOfFinalFeatures = m_numberOfFeatures;
+    m_binning.clear();
+    m_purityBinning.clear();
     for(unsigned int iFeature = 0; iFeature < m_numberOfFeatures; ++iFeature) {
-      auto feature = X[iFeature];
-      m_featureBinning.push_back(FeatureBinning<float>(m_binning[iFeature], feature));
+      m_binning.push_back(levels[iFeature]);
       if(m_purityTransformation[iFeature]) {
         m_numberOfFinalFeatures++;
-        std::vector<unsigned int> feature(numberOfEvents);
-        for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
-          feature[iEvent] = m_featureBinning[iFeature].ValueToBin(X[iFeature][iEvent]);
-        }
-        m_purityBinning.push_back(PurityTransformation(m_binning[iFeature], feature, w, y));
-        m_binning.insert(m_binning.begin() + iFeature + 1, m_binning[iFeature]);
+        m_purityBinning.push_back(purityBinning[iFeature]);
+        m_binning.push_back(levels[iFeature]);
       }
     }
-    
     for(unsigned int iFeature = 0; iFeature < m_numberOfFlatnessFeatures; ++iFeature) {
-      auto feature = X[iFeature + m_numberOfFeatures];
-      m_featureBinning.push_back(FeatureBinning<float>(m_binning[iFeature + m_numberOfFinalFeatures], feature));
+      m_binning.push_back(levels[iFeature + m_numberOfFeatures]);
     }
   
-    EventSample eventSample(numberOfEvents, m_numberOfFinalFeatures, m_numberOfFlatnessFeatures, m_binning);
-    std::vector<unsigned int> bins(m_numberOfFinalFeatures+m_numberOfFlatnessFeatures);
+    if(m_aggregateDuplicates and m_sPlot) {
+      throw std::runtime_error("Aggregating duplicate events cannot be combined with the sPlot pairing of the events");
+    }
+
+    if(m_maxLeaves == 1) {
+      throw std::runtime_error("A best-first tree requires at least two leaves");
+    }
 
-    for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+    auto binEvent = [&](unsigned int iEvent, std::vector<unsigned int> &bins) {
       unsigned int bin = 0;
       unsigned int pFeature = 0; 
       for(unsigned int iFeature = 0; iFeature < m_numberOfFeatures; ++iFeature) {
@@ -91,12 +149,72 @@ namespace FastBDT {
         bins[bin] = m_featureBinning[iFeature + m_numberOfFeatures].ValueToBin(X[iFeature + m_numberOfFeatures][iEvent]);
         bin++;
       }
-      eventSample.AddEvent(bins, w[iEvent], y[iEvent] == 1);
+    };
+
+    std::vector<unsigned int> bins(m_numberOfFinalFeatures+m_numberOfFlatnessFeatures);
+    std::unique_ptr<EventSample> eventSample;
+    if(m_aggregateDuplicates) {
+      // Events of the same class with identical bins are indistinguishable for the training,
+      // so they are merged into a single event with the sum of their weights, in the order of their first occurrence
+      std::unordered_map<std::vector<unsigned int>, unsigned int, BinsHash> uniqueEvents[2];
+      std::vector<std::vector<unsigned int>> uniqueBins;
+      std::vector<double> uniqueWeights;
+      std::vector<bool> uniqueIsSignal;
+      for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+        binEvent(iEvent, bins);
+        const bool isSignal = y[iEvent] == 1;
+        auto inserted = uniqueEvents[isSignal].insert({bins, static_cast<unsigned int>(uniqueBins.size())});
+        if(inserted.second) {
+          uniqueBins.push_back(bins);
+          uniqueWeights.push_back(w[iEvent]);
+          uniqueIsSignal.push_back(isSignal);
+        } else {
+          uniqueWeights[inserted.first->second] += w[iEvent];
+        }
+      }
+      eventSample.reset(new EventSample(uniqueBins.size(), m_numberOfFinalFeatures, m_numberOfFlatnessFeatures, m_binning, true, m_columnMajor));
+      for(unsigned int iUnique = 0; iUnique < uniqueBins.size(); ++iUnique)
+        eventSample->AddEvent(uniqueBins[iUnique], uniqueWeights[iUnique], uniqueIsSignal[iUnique]);
+    } else {
+      eventSample.reset(new EventSample(numberOfEvents, m_numberOfFinalFeatures, m_numberOfFlatnessFeatures, m_binning, true, m_columnMajor));
+
+      // The i-th signal (background) event goes into the i-th signal (background) slot, so the positions are the
+      // same as if the events were added one by one. The positions are encoded in parallel in chunks of an even
+      // number of events, because two neighbouring positions may share a byte, see EventValues::Set
+      std::vector<unsigned int> signalEvents;
+      std::vector<unsigned int> bckgrdEvents;
+      for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+        if(y[iEvent] == 1)
+          signalEvents.push_back(iEvent);
+        else
+          bckgrdEvents.push_back(iEvent);
+      }
+      eventSample->ReserveSlots(signalEvents.size());
+
+      const unsigned int chunkSize = 1 << 16;
+      const unsigned int nChunks = (numberOfEvents + chunkSize - 1) / chunkSize;
+      std::atomic<unsigned int> nextChunk(0);
+      RunInParallel(std::min(m_nThreads, nChunks), [&](unsigned int) {
+        std::vector<unsigned int> bins(m_numberOfFinalFeatures+m_numberOfFlatnessFeatures);
+        for(unsigned int iChunk = nextChunk++; iChunk < nChunks; iChunk = nextChunk++) {
+          const unsigned int last = std::min(numberOfEvents, (iChunk + 1) * chunkSize);
+          for(unsigned int iPosition = iChunk * chunkSize; iPosition < last; ++iPosition) {
+            const bool isSignal = iPosition < signalEvents.size();
+            const unsigned int slot = isSignal ? iPosition : numberOfEvents - 1 - iPosition;
+            const unsigned int iEvent = isSignal ? signalEvents[slot] : bckgrdEvents[slot];
+            binEvent(iEvent, bins);
+            eventSample->AddEvent(slot, bins, w[iEvent], isSignal);
+          }
+        }
+      });
     }
+    eventSample->SetHistogramTileSize(m_histogramTileSize);
    
     m_featureBinning.resize(m_numberOfFeatures);
 
-    ForestBuilder df(eventSample, m_nTrees, m_shrinkage, m_subsample, m_depth, m_sPlot, m_flatnessLoss);
+    const unsigned int seed = (m_seed != 0) ? m_seed : static_cast<unsigned int>(std::rand());
+    ForestBuilder df(*eventSample, m_nTrees, m_shrinkage, m_subsample, m_depth, m_sPlot, m_flatnessLoss, m_nThreads, seed, m_stratifiedSubsample, m_gossTopFraction, m_maxLeaves);
+    m_outOfBagLoss = df.GetOutOfBagLoss();
     if(m_can_use_fast_forest) {
         Forest<float> temp_forest( df.GetShrinkage(), df.GetF0(), m_transform2probability);
         for( auto t : df.GetForest() ) {
@@ -218,6 +336,12 @@ std::ostream& operator<<(std::ostream& stream, const Classifier& classifier) {
     stream << classifier.m_flatnessLoss << std::endl;
     stream << classifier.m_purityTransformation << std::endl;
     stream << classifier.m_transform2probability << std::endl;
+    if(classifier.m_version >= 2) {
+      std::vector<unsigned int> binningStrategy;
+      for(auto &strategy : classifier.m_binningStrategy)
+        binningStrategy.push_back(static_cast<unsigned int>(strategy));
+      stream << binningStrategy << std::endl;
+    }
     stream << classifier.m_featureBinning << std::endl;
     stream << classifier.m_purityBinning << std::endl;
     stream << classifier.m_numberOfFeatures << std::endl;
@@ -7,27 +7,81 @@
 
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <exception>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
 namespace FastBDT {
 
+  void RunInParallel(unsigned int nThreads, const std::function<void(unsigned int)> &function) {
+
+    if(nThreads <= 1) {
+      function(0);
+      return;
+    }
+
+    // Exceptions cannot cross thread boundaries, so we store them and rethrow the first one afterwards
+    std::vector<std::exception_ptr> exceptions(nThreads);
+    auto call = [&](unsigned int iThread) {
+      try {
+        function(iThread);
+      } catch(...) {
+        exceptions[iThread] = std::current_exception();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads - 1);
+    for(unsigned int iThread = 1; iThread < nThreads; ++iThread)
+      threads.emplace_back(call, iThread);
+    call(0);
+
+    for(auto &thread : threads)
+      thread.join();
+
+    for(auto &exception : exceptions)
+      if(exception)
+        std::rethrow_exception(exception);
+
+  }
+
+  /**
+   * The histograms are filled in chunks of events, the number of chunks depends only on the number of events.
+   * A chunk contains at least 2^16 events, and there are at most 64 chunks.
+   */
+  static unsigned int GetNumberOfChunks(unsigned int nEvents) {
+    const unsigned int minimumChunkSize = 1 << 16;
+    const unsigned int maximumNumberOfChunks = 64;
+    return std::max(1u, std::min(maximumNumberOfChunks, (nEvents + minimumChunkSize - 1) / minimumChunkSize));
+  }
+
+  static unsigned int GetChunkBoundary(unsigned int firstEvent, unsigned int lastEvent, unsigned int iChunk, unsigned int nChunks) {
+    return firstEvent + static_cast<unsigned int>((static_cast<uint64_t>(lastEvent - firstEvent) * iChunk) / nChunks);
+  }
+
   std::vector<Weight> EventWeights::GetSums(unsigned int nSignals) const {
 
     // Vectorizing FTW!
     std::vector<Weight> sums(3,0);
     for(unsigned int i = 0; i < nSignals; ++i) {
-      sums[0] += weights[i] * original_weights[i];
+      sums[0] += effective_weights[i];
       sums[2] += weights[i]*weights[i] * original_weights[i];
     }
 
     for(unsigned int i = nSignals; i < weights.size(); ++i) {
-      sums[1] += weights[i] * original_weights[i];
+      sums[1] += effective_weights[i];
       sums[2] += weights[i]*weights[i] * original_weights[i];
     }
     return sums;
 
   }
   
-  EventValues::EventValues(unsigned int nEvents, unsigned int nFeatures, unsigned int nSpectators, const std::vector<unsigned int> &nLevels) : values(nEvents*(nFeatures+nSpectators), 0), nFeatures(nFeatures), nSpectators(nSpectators) {
+  EventValues::EventValues(unsigned int nEvents, unsigned int nFeatures, unsigned int nSpectators, const std::vector<unsigned int> &nLevels, bool compact, bool columnMajor) : nFeatures(nFeatures), nSpectators(nSpectators), columnMajor(columnMajor) {
 
     if(nFeatures + nSpectators != nLevels.size()) {
       throw std::runtime_error("Number of features must be the same as the number of provided binning levels!");
@@ -42,6 +96,48 @@ namespace FastBDT {
     for(auto &nBin : nBins) 
       nBinSums.push_back(nBinSums.back() + nBin);
 
+    // The largest value of a feature is nBins, which determines the required width
+    bitWidths.reserve(nBins.size());
+    for(auto &nBin : nBins) {
+      if( not compact )
+        bitWidths.push_back(32);
+      else if( nBin < (1u << 4) )
+        bitWidths.push_back(4);
+      else if( nBin < (1u << 8) )
+        bitWidths.push_back(8);
+      else if( nBin < (1u << 16) )
+        bitWidths.push_back(16);
+      else
+        bitWidths.push_back(32);
+    }
+
+    bitOffsets.resize(nBins.size());
+    bitStrides.resize(nBins.size());
+    if( columnMajor ) {
+      // Every column starts at a multiple of 8 bytes
+      uint64_t nBytes = 0;
+      for(unsigned int iFeature = 0; iFeature < nBins.size(); ++iFeature) {
+        bitOffsets[iFeature] = nBytes * 8;
+        bitStrides[iFeature] = bitWidths[iFeature];
+        nBytes += ((static_cast<uint64_t>(nEvents) * bitWidths[iFeature] + 63) / 64) * 8;
+      }
+      values.resize(nBytes, 0);
+    } else {
+      // The widest features are placed first in the record, so every feature is aligned to its own width
+      uint64_t bitStride = 0;
+      for(unsigned int width : {32, 16, 8, 4}) {
+        for(unsigned int iFeature = 0; iFeature < nBins.size(); ++iFeature) {
+          if( bitWidths[iFeature] != width )
+            continue;
+          bitOffsets[iFeature] = bitStride;
+          bitStride += width;
+        }
+      }
+      bitStride = (bitStride + 7) & ~static_cast<uint64_t>(7);
+      std::fill(bitStrides.begin(), bitStrides.end(), bitStride);
+      values.resize((bitStride * nEvents) / 8, 0);
+    }
+
   }
 
   void EventValues::Set(unsigned int iEvent, const std::vector<unsigned int> &features) {
@@ -59,7 +155,95 @@ namespace FastBDT {
 
     // Now add the new values to the values vector.
     for(unsigned int iFeature = 0; iFeature < nFeatures+nSpectators; ++iFeature) {
-      values[iEvent*(nFeatures+nSpectators) + iFeature] = features[iFeature];
+      const uint64_t bit = bitOffsets[iFeature] + static_cast<uint64_t>(iEvent) * bitStrides[iFeature];
+      unsigned char *byte = values.data() + (bit >> 3);
+      switch(bitWidths[iFeature]) {
+        case 4:
+          *byte = (*byte & ~(0xF << (bit & 7))) | (features[iFeature] << (bit & 7));
+          break;
+        case 8:
+          *byte = features[iFeature];
+          break;
+        case 16: {
+          const uint16_t value = features[iFeature];
+          std::memcpy(byte, &value, sizeof(value));
+          break;
+        }
+        default: {
+          const uint32_t value = features[iFeature];
+          std::memcpy(byte, &value, sizeof(value));
+          break;
+        }
+      }
+    }
+
+  }
+
+  void EventSample::SetHistogramTileSize(unsigned int nBytes) {
+
+    // The automatic size is a part of a typical L2 cache, so the tile stays
+    // in the cache together with the values and weights of a block of events
+    const unsigned int automaticTileSize = 64 * 1024;
+    histogramTileSize = nBytes;
+    const unsigned int tileSize = (nBytes == 0) ? automaticTileSize : nBytes;
+
+    // Every bin stores the signal and background weight
+    const auto &nBinSums = values.GetNBinSums();
+    const unsigned int nFeatures = values.GetNFeatures();
+    featureTiles = {0};
+    for(unsigned int iFeature = 1; iFeature < nFeatures; ++iFeature) {
+      if( 2 * sizeof(Weight) * (nBinSums[iFeature + 1] - nBinSums[featureTiles.back()]) > tileSize )
+        featureTiles.push_back(iFeature);
+    }
+    featureTiles.push_back(nFeatures);
+
+  }
+
+  /**
+   * Reads the values of the given events from a column of values with the given width
+   */
+  template<unsigned int width>
+  static void ReadColumn(const unsigned char *column, const unsigned int *first, const unsigned int *last, unsigned int *out) {
+    for(const unsigned int *iter = first; iter != last; ++iter, ++out) {
+      const uint64_t iEvent = *iter;
+      if( width == 4 ) {
+        *out = (column[iEvent >> 1] >> ((iEvent & 1) << 2)) & 0xF;
+      } else if( width == 8 ) {
+        *out = column[iEvent];
+      } else if( width == 16 ) {
+        uint16_t value;
+        std::memcpy(&value, column + 2*iEvent, sizeof(value));
+        *out = value;
+      } else {
+        uint32_t value;
+        std::memcpy(&value, column + 4*iEvent, sizeof(value));
+        *out = value;
+      }
+    }
+  }
+
+  void EventValues::GetFeatureValues(unsigned int iFeature, const unsigned int *first, const unsigned int *last, unsigned int *out) const {
+
+    if( not columnMajor ) {
+      for(const unsigned int *iter = first; iter != last; ++iter, ++out)
+        *out = Get(*iter, iFeature);
+      return;
+    }
+
+    const unsigned char *column = values.data() + bitOffsets[iFeature] / 8;
+    switch(bitWidths[iFeature]) {
+      case 4:
+        ReadColumn<4>(column, first, last, out);
+        break;
+      case 8:
+        ReadColumn<8>(column, first, last, out);
+        break;
+      case 16:
+        ReadColumn<16>(column, first, last, out);
+        break;
+      default:
+        ReadColumn<32>(column, first, last, out);
+        break;
     }
 
   }
@@ -94,6 +278,37 @@ namespace FastBDT {
 
   }
 
+  void EventSample::ReserveSlots(unsigned int _nSignals) {
+
+    if(nSignals + nBckgrds != 0) {
+      throw std::runtime_error("Slots must be reserved before any event is added.");
+    }
+
+    if(_nSignals > nEvents) {
+      throw std::runtime_error("Promised maximum number of events exceeded.");
+    }
+
+    nSignals = _nSignals;
+    nBckgrds = nEvents - _nSignals;
+
+  }
+
+  void EventSample::AddEvent(unsigned int slot, const std::vector<unsigned int> &features, Weight weight, bool isSignal) {
+
+    if(slot >= (isSignal ? nSignals : nBckgrds)) {
+      throw std::runtime_error("Slot of the event was not reserved.");
+    }
+
+    if(std::isnan(weight)) {
+      throw std::runtime_error("NAN values as weights are not supported!");
+    }
+
+    const unsigned int index = GetSlotPosition(slot, isSignal);
+    weights.SetOriginal(index, weight);
+    values.Set(index, features);
+
+  }
+
   Weight LossFunction(const Weight &nSignal, const Weight &nBckgrd) {
     // Gini-Index x total number of events (needed to calculate information gain efficiently)!
     if( nSignal <= 0 or nBckgrd <= 0 )
@@ -102,7 +317,270 @@ namespace FastBDT {
     //return (nSignal*nBckgrd)/((nSignal+nBckgrd)*(nSignal+nBckgrd));
   }
 
-  CumulativeDistributions::CumulativeDistributions(const unsigned int iLayer, const EventSample &sample) {
+  static int FindBestCutScalar(const Weight *CDF, unsigned int firstCut, unsigned int nCuts, Weight signal, Weight bckgrd, Weight currentLoss, Weight &bestGain) {
+
+    int bestCut = -1;
+    for(unsigned int iCut = firstCut; iCut < nCuts; ++iCut) {
+      const Weight s = CDF[2*iCut];
+      const Weight b = CDF[2*iCut+1];
+      const Weight currentGain = currentLoss - LossFunction( signal-s, bckgrd-b ) - LossFunction( s, b );
+      if( bestGain <= currentGain ) {
+        bestGain = currentGain;
+        bestCut = iCut;
+      }
+    }
+    return bestCut;
+
+  }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FastBDT_HAS_X86_KERNELS
+
+  /**
+   * The vectorized kernels evaluate the loss function exactly like the scalar LossFunction, including the
+   * NaN propagation, because the basic floating point operations are correctly rounded in both cases.
+   * The interleaved signal and background values are separated by shuffles, which can change the order
+   * of the positions within a vector. Every lane keeps its own best gain and the last position at which it was reached,
+   * the lanes are merged by choosing the largest gain and among equal gains the last position.
+   * The remaining cuts are handled by the scalar kernel, which continues with the merged result.
+   */
+  __attribute__((target("avx2")))
+  static __m256 LossFunctionAVX2(__m256 nSignal, __m256 nBckgrd) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 isZero = _mm256_or_ps(_mm256_cmp_ps(nSignal, zero, _CMP_LE_OQ), _mm256_cmp_ps(nBckgrd, zero, _CMP_LE_OQ));
+    const __m256 loss = _mm256_div_ps(_mm256_mul_ps(nSignal, nBckgrd), _mm256_add_ps(nSignal, nBckgrd));
+    return _mm256_andnot_ps(isZero, loss);
+  }
+
+  __attribute__((target("avx2")))
+  static int FindBestCutAVX2(const Weight *CDF, unsigned int nCuts, Weight signal, Weight bckgrd, Weight currentLoss, Weight &bestGain) {
+
+    const unsigned int nVectorCuts = nCuts - nCuts % 8;
+    if( nVectorCuts == 0 )
+      return FindBestCutScalar(CDF, 0, nCuts, signal, bckgrd, currentLoss, bestGain);
+
+    const __m256 signalTotal = _mm256_set1_ps(signal);
+    const __m256 bckgrdTotal = _mm256_set1_ps(bckgrd);
+    const __m256 loss = _mm256_set1_ps(currentLoss);
+    __m256 bestGains = _mm256_set1_ps(bestGain);
+    __m256i bestCuts = _mm256_set1_epi32(-1);
+    // The shuffles within the 128 bit lanes yield the positions 0, 1, 4, 5, 2, 3, 6, 7
+    __m256i cuts = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    for(unsigned int iCut = 0; iCut < nVectorCuts; iCut += 8) {
+      const __m256 first = _mm256_loadu_ps(CDF + 2*iCut);
+      const __m256 second = _mm256_loadu_ps(CDF + 2*iCut + 8);
+      const __m256 s = _mm256_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m256 b = _mm256_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+      const __m256 gains = _mm256_sub_ps(_mm256_sub_ps(loss, LossFunctionAVX2(_mm256_sub_ps(signalTotal, s), _mm256_sub_ps(bckgrdTotal, b))), LossFunctionAVX2(s, b));
+      const __m256 better = _mm256_cmp_ps(bestGains, gains, _CMP_LE_OQ);
+      bestGains = _mm256_blendv_ps(bestGains, gains, better);
+      bestCuts = _mm256_blendv_epi8(bestCuts, cuts, _mm256_castps_si256(better));
+      cuts = _mm256_add_epi32(cuts, step);
+    }
+
+    alignas(32) float laneGains[8];
+    alignas(32) int laneCuts[8];
+    _mm256_store_ps(laneGains, bestGains);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneCuts), bestCuts);
+
+    int bestCut = -1;
+    for(unsigned int iLane = 0; iLane < 8; ++iLane) {
+      if( laneCuts[iLane] < 0 )
+        continue;
+      if( bestCut < 0 or laneGains[iLane] > bestGain or (laneGains[iLane] == bestGain and laneCuts[iLane] > bestCut) ) {
+        bestGain = laneGains[iLane];
+        bestCut = laneCuts[iLane];
+      }
+    }
+
+    const int tailCut = FindBestCutScalar(CDF, nVectorCuts, nCuts, signal, bckgrd, currentLoss, bestGain);
+    return tailCut >= 0 ? tailCut : bestCut;
+
+  }
+
+  __attribute__((target("avx512f")))
+  static __m512 LossFunctionAVX512(__m512 nSignal, __m512 nBckgrd) {
+    const __m512 zero = _mm512_setzero_ps();
+    const __mmask16 isZero = _mm512_cmp_ps_mask(nSignal, zero, _CMP_LE_OQ) | _mm512_cmp_ps_mask(nBckgrd, zero, _CMP_LE_OQ);
+    const __m512 loss = _mm512_div_ps(_mm512_mul_ps(nSignal, nBckgrd), _mm512_add_ps(nSignal, nBckgrd));
+    return _mm512_mask_mov_ps(loss, isZero, zero);
+  }
+
+  __attribute__((target("avx512f")))
+  static int FindBestCutAVX512(const Weight *CDF, unsigned int nCuts, Weight signal, Weight bckgrd, Weight currentLoss, Weight &bestGain) {
+
+    const unsigned int nVectorCuts = nCuts - nCuts % 16;
+    if( nVectorCuts == 0 )
+      return FindBestCutScalar(CDF, 0, nCuts, signal, bckgrd, currentLoss, bestGain);
+
+    const __m512 signalTotal = _mm512_set1_ps(signal);
+    const __m512 bckgrdTotal = _mm512_set1_ps(bckgrd);
+    const __m512 loss = _mm512_set1_ps(currentLoss);
+    __m512 bestGains = _mm512_set1_ps(bestGain);
+    __m512i bestCuts = _mm512_set1_epi32(-1);
+    __m512i cuts = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i step = _mm512_set1_epi32(16);
+    const __m512i signalIndices = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i bckgrdIndices = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+
+    for(unsigned int iCut = 0; iCut < nVectorCuts; iCut += 16) {
+      const __m512 first = _mm512_loadu_ps(CDF + 2*iCut);
+      const __m512 second = _mm512_loadu_ps(CDF + 2*iCut + 16);
+      const __m512 s = _mm512_permutex2var_ps(first, signalIndices, second);
+      const __m512 b = _mm512_permutex2var_ps(first, bckgrdIndices, second);
+      const __m512 gains = _mm512_sub_ps(_mm512_sub_ps(loss, LossFunctionAVX512(_mm512_sub_ps(signalTotal, s), _mm512_sub_ps(bckgrdTotal, b))), LossFunctionAVX512(s, b));
+      const __mmask16 better = _mm512_cmp_ps_mask(bestGains, gains, _CMP_LE_OQ);
+      bestGains = _mm512_mask_mov_ps(bestGains, better, gains);
+      bestCuts = _mm512_mask_mov_epi32(bestCuts, better, cuts);
+      cuts = _mm512_add_epi32(cuts, step);
+    }
+
+    alignas(64) float laneGains[16];
+    alignas(64) int laneCuts[16];
+    _mm512_store_ps(laneGains, bestGains);
+    _mm512_store_si512(laneCuts, bestCuts);
+
+    int bestCut = -1;
+    for(unsigned int iLane = 0; iLane < 16; ++iLane) {
+      if( laneCuts[iLane] < 0 )
+        continue;
+      if( bestCut < 0 or laneGains[iLane] > bestGain or (laneGains[iLane] == bestGain and laneCuts[iLane] > bestCut) ) {
+        bestGain = laneGains[iLane];
+        bestCut = laneCuts[iLane];
+      }
+    }
+
+    const int tailCut = FindBestCutScalar(CDF, nVectorCuts, nCuts, signal, bckgrd, currentLoss, bestGain);
+    return tailCut >= 0 ? tailCut : bestCut;
+
+  }
+#endif
+
+  bool IsSupported(InstructionSet instructionSet) {
+    switch(instructionSet) {
+      case InstructionSet::Scalar:
+        return true;
+#ifdef FastBDT_HAS_X86_KERNELS
+      case InstructionSet::AVX2:
+        return __builtin_cpu_supports("avx2");
+      case InstructionSet::AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+      default:
+        return false;
+    }
+  }
+
+  InstructionSet GetBestInstructionSet() {
+    static const InstructionSet best = IsSupported(InstructionSet::AVX512) ? InstructionSet::AVX512 :
+                                       (IsSupported(InstructionSet::AVX2) ? InstructionSet::AVX2 : InstructionSet::Scalar);
+    return best;
+  }
+
+  int FindBestCut(const Weight *CDF, unsigned int nCuts, Weight signal, Weight bckgrd, Weight currentLoss, Weight &bestGain, InstructionSet instructionSet) {
+    switch(instructionSet) {
+#ifdef FastBDT_HAS_X86_KERNELS
+      case InstructionSet::AVX2:
+        return FindBestCutAVX2(CDF, nCuts, signal, bckgrd, currentLoss, bestGain);
+      case InstructionSet::AVX512:
+        return FindBestCutAVX512(CDF, nCuts, signal, bckgrd, currentLoss, bestGain);
+#endif
+      default:
+        return FindBestCutScalar(CDF, 0, nCuts, signal, bckgrd, currentLoss, bestGain);
+    }
+  }
+
+  static void CalculateBoostWeightsScalar(const double *F, unsigned int first, unsigned int last, double factor, Weight *weights) {
+    for(unsigned int i = first; i < last; ++i)
+      weights[i] = 2.0/(1.0+std::exp(factor*F[i]));
+  }
+
+#ifdef FastBDT_HAS_X86_KERNELS
+  /**
+   * exp(x) is calculated as 2^n * exp(r) with n = round(x / ln 2) and |r| <= ln 2 / 2.
+   * exp(r) is approximated by its Taylor series up to r^13, whose truncation error is below 1e-17.
+   * 2^n is constructed directly in the exponent bits, therefore x is clamped to [-708, 709], which
+   * does not change the boosting weight in single precision. NaN values are propagated.
+   */
+  static const double expClampLow = -708.0;
+  static const double expClampHigh = 709.0;
+  static const double log2e = 1.4426950408889634;
+  static const double ln2High = 0.693145751953125;
+  static const double ln2Low = 1.42860682030941723212e-6;
+  static const double expCoefficients[14] = {1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320, 1.0/362880,
+                                             1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800};
+
+  __attribute__((target("avx2")))
+  static void CalculateBoostWeightsAVX2(const double *F, unsigned int nEvents, double factor, Weight *weights) {
+
+    const unsigned int nVectorEvents = nEvents - nEvents % 4;
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    for(unsigned int i = 0; i < nVectorEvents; i += 4) {
+      // min and max return their second operand if one of them is NaN
+      __m256d x = _mm256_mul_pd(_mm256_set1_pd(factor), _mm256_loadu_pd(F + i));
+      x = _mm256_max_pd(_mm256_set1_pd(expClampLow), _mm256_min_pd(_mm256_set1_pd(expClampHigh), x));
+      const __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+      __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(ln2High)));
+      r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(ln2Low)));
+      __m256d p = _mm256_set1_pd(expCoefficients[13]);
+      for(int k = 12; k >= 0; --k)
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(expCoefficients[k]));
+      // Adding 1.5 * 2^52 moves the integer n into the low mantissa bits
+      const __m256i bits = _mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(6755399441055744.0)));
+      const __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1023)), 52));
+      const __m256d result = _mm256_div_pd(two, _mm256_add_pd(one, _mm256_mul_pd(p, scale)));
+      _mm_storeu_ps(weights + i, _mm256_cvtpd_ps(result));
+    }
+    CalculateBoostWeightsScalar(F, nVectorEvents, nEvents, factor, weights);
+
+  }
+
+  // The AVX512 intrinsics start from undefined vectors, which GCC reports as maybe uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  __attribute__((target("avx512f")))
+  static void CalculateBoostWeightsAVX512(const double *F, unsigned int nEvents, double factor, Weight *weights) {
+
+    const unsigned int nVectorEvents = nEvents - nEvents % 8;
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d two = _mm512_set1_pd(2.0);
+    for(unsigned int i = 0; i < nVectorEvents; i += 8) {
+      __m512d x = _mm512_mul_pd(_mm512_set1_pd(factor), _mm512_loadu_pd(F + i));
+      x = _mm512_max_pd(_mm512_set1_pd(expClampLow), _mm512_min_pd(_mm512_set1_pd(expClampHigh), x));
+      const __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+      __m512d r = _mm512_sub_pd(x, _mm512_mul_pd(n, _mm512_set1_pd(ln2High)));
+      r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(ln2Low)));
+      __m512d p = _mm512_set1_pd(expCoefficients[13]);
+      for(int k = 12; k >= 0; --k)
+        p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(expCoefficients[k]));
+      const __m512i bits = _mm512_castpd_si512(_mm512_add_pd(n, _mm512_set1_pd(6755399441055744.0)));
+      const __m512d scale = _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_add_epi64(bits, _mm512_set1_epi64(1023)), 52));
+      const __m512d result = _mm512_div_pd(two, _mm512_add_pd(one, _mm512_mul_pd(p, scale)));
+      _mm256_storeu_ps(weights + i, _mm512_cvtpd_ps(result));
+    }
+    CalculateBoostWeightsScalar(F, nVectorEvents, nEvents, factor, weights);
+
+  }
+#pragma GCC diagnostic pop
+#endif
+
+  void CalculateBoostWeights(const double *F, unsigned int nEvents, double factor, Weight *weights, InstructionSet instructionSet) {
+    switch(instructionSet) {
+#ifdef FastBDT_HAS_X86_KERNELS
+      case InstructionSet::AVX2:
+        return CalculateBoostWeightsAVX2(F, nEvents, factor, weights);
+      case InstructionSet::AVX512:
+        return CalculateBoostWeightsAVX512(F, nEvents, factor, weights);
+#endif
+      default:
+        return CalculateBoostWeightsScalar(F, 0, nEvents, factor, weights);
+    }
+  }
+
+  void CumulativeDistributions::Initialise(const unsigned int iLayer, const EventSample &sample) {
 
     const auto &values = sample.GetValues();
     nFeatures = values.GetNFeatures();
@@ -110,42 +588,284 @@ namespace FastBDT {
     nBins = values.GetNBins();
     nBinSums = values.GetNBinSums();
 
-    signalCDFs = CalculateCDFs(sample, 0, sample.GetNSignals());
-    bckgrdCDFs = CalculateCDFs(sample, sample.GetNSignals(), sample.GetNEvents());
+  }
+
+  CumulativeDistributions::CumulativeDistributions(const unsigned int iLayer, const EventSample &sample, unsigned int nThreads) {
+
+    Initialise(iLayer, sample);
+
+    // The events of the nodes in this layer have the flags nNodes, ..., 2*nNodes-1,
+    // they are sorted by their node, keeping the order of the events within each node
+    const auto &flags = sample.GetFlags();
+    std::vector<EventRange> eventRanges(nNodes);
+    for(unsigned int iEvent = 0; iEvent < sample.GetNEvents(); ++iEvent) {
+      const int flag = flags.Get(iEvent);
+      if( flag >= static_cast<int>(nNodes) and flag < static_cast<int>(2*nNodes) )
+        eventRanges[flag - nNodes].last++;
+    }
+    unsigned int nSelectedEvents = 0;
+    for(auto &range : eventRanges) {
+      range.first = nSelectedEvents;
+      nSelectedEvents += range.last;
+      range.last = range.first;
+    }
+
+    std::vector<unsigned int> eventIndices(nSelectedEvents);
+    for(unsigned int iEvent = 0; iEvent < sample.GetNEvents(); ++iEvent) {
+      const int flag = flags.Get(iEvent);
+      if( flag >= static_cast<int>(nNodes) and flag < static_cast<int>(2*nNodes) )
+        eventIndices[eventRanges[flag - nNodes].last++] = iEvent;
+    }
+
+    CDFs = CalculateCDFs(sample, eventIndices, eventRanges, nThreads);
+
+  }
+
+  CumulativeDistributions::CumulativeDistributions(const unsigned int iLayer, const EventSample &sample, const std::vector<unsigned int> &eventIndices, const std::vector<EventRange> &eventRanges, unsigned int nThreads) {
+
+    Initialise(iLayer, sample);
+
+    if(eventRanges.size() != nNodes) {
+      throw std::runtime_error("Every node of the layer requires a range of events.");
+    }
+
+    CDFs = CalculateCDFs(sample, eventIndices, eventRanges, nThreads);
+
+  }
+
+  CumulativeDistributions::CumulativeDistributions(const unsigned int iLayer, const EventSample &sample, const CumulativeDistributions &parentCDFs, const std::vector<int> &filledChildren,
+                                                   const std::vector<unsigned int> &eventIndices, const std::vector<EventRange> &eventRanges, unsigned int nThreads) {
+
+    Initialise(iLayer, sample);
+    CheckParentCDFs(iLayer, parentCDFs, filledChildren);
+
+    if(eventRanges.size() != nNodes) {
+      throw std::runtime_error("Every node of the layer requires a range of events.");
+    }
+
+    // The histograms of the filled children are stored at the position of the child,
+    // the events dropped at a parent node are stored after all children at nNodes + iParent.
+    // The dropped events are located between the ranges of the two children.
+    const unsigned int nParents = nNodes / 2;
+    std::vector<EventRange> histogramRanges(nNodes + nParents);
+    for(unsigned int iParent = 0; iParent < nParents; ++iParent) {
+      if( filledChildren[iParent] < 0 )
+        continue;
+      const unsigned int iChild = 2*iParent + filledChildren[iParent];
+      histogramRanges[iChild] = eventRanges[iChild];
+      histogramRanges[nNodes + iParent].first = eventRanges[2*iParent].last;
+      histogramRanges[nNodes + iParent].last = eventRanges[2*iParent + 1].first;
+    }
+
+    CDFs = CalculateCDFs(sample, eventIndices, histogramRanges, nThreads);
+    SubtractSiblings(parentCDFs, filledChildren);
 
   }
 
-  std::vector<Weight> CumulativeDistributions::CalculateCDFs(const EventSample &sample, const unsigned int firstEvent, const unsigned int lastEvent) const {
+  CumulativeDistributions::CumulativeDistributions(const unsigned int iLayer, const EventSample &sample, const CumulativeDistributions &parentCDFs, const std::vector<int> &filledChildren,
+                                                   std::vector<Weight> bins) {
+
+    Initialise(iLayer, sample);
+    CheckParentCDFs(iLayer, parentCDFs, filledChildren);
+
+    if(bins.size() != (nNodes + nNodes / 2) * GetNBinsPerNode()) {
+      throw std::runtime_error("The histograms do not fit to the number of nodes and bins of the layer.");
+    }
+
+    CDFs = std::move(bins);
+    Accumulate(CDFs);
+    SubtractSiblings(parentCDFs, filledChildren);
+
+  }
+
+  CumulativeDistributions::CumulativeDistributions(const CumulativeDistributions &CDFs, unsigned int iNode) : nFeatures(CDFs.nFeatures), nBins(CDFs.nBins), nBinSums(CDFs.nBinSums), nNodes(1) {
+
+    if(iNode >= CDFs.nNodes) {
+      throw std::runtime_error("The node is not part of the cumulative distributions.");
+    }
+
+    const unsigned int nBinsPerNode = GetNBinsPerNode();
+    this->CDFs.assign(CDFs.CDFs.begin() + iNode*nBinsPerNode, CDFs.CDFs.begin() + (iNode + 1)*nBinsPerNode);
+
+  }
+
+  void CumulativeDistributions::CheckParentCDFs(const unsigned int iLayer, const CumulativeDistributions &parentCDFs, const std::vector<int> &filledChildren) const {
+
+    if(iLayer == 0 or parentCDFs.GetNNodes() != (1u << (iLayer - 1)) or filledChildren.size() != parentCDFs.GetNNodes()) {
+      throw std::runtime_error("Cumulative distributions of the previous layer are required to calculate the distributions of a layer.");
+    }
+
+  }
+
+  void CumulativeDistributions::SubtractSiblings(const CumulativeDistributions &parentCDFs, const std::vector<int> &filledChildren) {
+
+    const unsigned int nBinsPerNode = GetNBinsPerNode();
+    const unsigned int nParents = nNodes / 2;
+
+    for(unsigned int iParent = 0; iParent < nParents; ++iParent) {
+      if( filledChildren[iParent] < 0 )
+        continue;
+      const unsigned int filled = (2*iParent + filledChildren[iParent]) * nBinsPerNode;
+      const unsigned int sibling = (2*iParent + 1 - filledChildren[iParent]) * nBinsPerNode;
+      const unsigned int dropped = (nNodes + iParent) * nBinsPerNode;
+      const unsigned int parent = iParent * nBinsPerNode;
+      for(unsigned int iBin = 0; iBin < nBinsPerNode; ++iBin) {
+        CDFs[sibling + iBin] = parentCDFs.CDFs[parent + iBin] - CDFs[filled + iBin] - CDFs[dropped + iBin];
+      }
+    }
+
+    // The histograms of the dropped events are not needed anymore
+    CDFs.resize(nNodes * nBinsPerNode);
+
+  }
+
+  void CumulativeDistributions::FillHistogram(const EventSample &sample, const unsigned int *first, const unsigned int *last, Weight *bins) {
 
     const auto &values = sample.GetValues();
-    const auto &flags = sample.GetFlags();
     const auto &weights = sample.GetWeights();
+    const unsigned int nFeatures = values.GetNFeatures();
+    const auto &nBinSums = values.GetNBinSums();
+    const unsigned int nSignals = sample.GetNSignals();
+
+    // The signal and background content of each bin are stored next to each other
+    if( values.IsColumnMajor() ) {
+      const unsigned int blockSize = 256;
+      Weight blockWeights[blockSize];
+      unsigned int blockClasses[blockSize];
+      unsigned int blockValues[blockSize];
+      for(const unsigned int *block = first; block != last; ) {
+        const unsigned int nBlockEvents = std::min(blockSize, static_cast<unsigned int>(last - block));
+        for(unsigned int i = 0; i < nBlockEvents; ++i) {
+          blockWeights[i] = weights.Get(block[i]);
+          blockClasses[i] = block[i] < nSignals ? 0 : 1;
+        }
+        // Fill Cut-PDFs feature by feature
+        for(unsigned int iFeature = 0; iFeature < nFeatures; ++iFeature ) {
+          values.GetFeatureValues(iFeature, block, block + nBlockEvents, blockValues);
+          Weight *featureBins = bins + 2*nBinSums[iFeature];
+          for(unsigned int i = 0; i < nBlockEvents; ++i)
+            featureBins[2*blockValues[i] + blockClasses[i]] += blockWeights[i];
+        }
+        block += nBlockEvents;
+      }
+      return;
+    }
+
+    // Fill Cut-PDFs for every feature
+    const auto &featureTiles = sample.GetFeatureTiles();
+    if( featureTiles.size() <= 2 ) {
+      for(const unsigned int *iter = first; iter != last; ++iter) {
+        const unsigned int iEvent = *iter;
+        const Weight weight = weights.Get(iEvent);
+        Weight *classBins = bins + (iEvent < nSignals ? 0 : 1);
+        for(unsigned int iFeature = 0; iFeature < nFeatures; ++iFeature ) {
+          classBins[2*(nBinSums[iFeature] + values.Get(iEvent,iFeature))] += weight;
+        }
+      }
+      return;
+    }
+
+    // If the histogram does not fit into the cache, a block of events is histogrammed tile by tile,
+    // every bin still receives the events in the same order
+    const unsigned int blockSize = 2048;
+    Weight blockWeights[blockSize];
+    for(const unsigned int *block = first; block != last; ) {
+      const unsigned int nBlockEvents = std::min(blockSize, static_cast<unsigned int>(last - block));
+      for(unsigned int i = 0; i < nBlockEvents; ++i)
+        blockWeights[i] = weights.Get(block[i]);
+      for(unsigned int iTile = 0; iTile + 1 < featureTiles.size(); ++iTile) {
+        const unsigned int firstFeature = featureTiles[iTile];
+        const unsigned int lastFeature = featureTiles[iTile + 1];
+        for(unsigned int i = 0; i < nBlockEvents; ++i) {
+          const unsigned int iEvent = block[i];
+          Weight *classBins = bins + (iEvent < nSignals ? 0 : 1);
+          for(unsigned int iFeature = firstFeature; iFeature < lastFeature; ++iFeature ) {
+            classBins[2*(nBinSums[iFeature] + values.Get(iEvent,iFeature))] += blockWeights[i];
+          }
+        }
+      }
+      block += nBlockEvents;
+    }
 
-    std::vector<Weight> bins( nNodes*nBinSums[nFeatures] );
+  }
 
-    // Fill Cut-PDFs for all nodes in this layer and for every feature
-    for(unsigned int iEvent = firstEvent; iEvent < lastEvent; ++iEvent) {
-      if( flags.Get(iEvent) < static_cast<int>(nNodes) )
+  std::vector<Weight> CumulativeDistributions::CalculateCDFs(const EventSample &sample, const std::vector<unsigned int> &eventIndices, const std::vector<EventRange> &eventRanges, const unsigned int nThreads) const {
+
+    const unsigned int nBinsPerNode = GetNBinsPerNode();
+    const unsigned int nHistograms = eventRanges.size();
+    std::vector<Weight> bins( nHistograms*nBinsPerNode );
+
+    // Histograms with only one chunk are filled directly, they are distributed dynamically over the workers
+    // because the number of events per node can be very different.
+    std::vector<unsigned int> smallHistograms;
+    std::vector<unsigned int> largeHistograms;
+    for(unsigned int iHistogram = 0; iHistogram < nHistograms; ++iHistogram) {
+      const auto &range = eventRanges[iHistogram];
+      if( range.first == range.last )
         continue;
-      const unsigned int index = (flags.Get(iEvent)-nNodes)*nBinSums[nFeatures];
-      for(unsigned int iFeature = 0; iFeature < nFeatures; ++iFeature ) {
-        const unsigned int subindex = nBinSums[iFeature] + values.Get(iEvent,iFeature);
-        bins[index+subindex] += weights.Get(iEvent);
+      if( GetNumberOfChunks(range.last - range.first) == 1 )
+        smallHistograms.push_back(iHistogram);
+      else
+        largeHistograms.push_back(iHistogram);
+    }
+
+    std::atomic<unsigned int> nextSmallHistogram(0);
+    RunInParallel(std::min(nThreads, static_cast<unsigned int>(smallHistograms.size())), [&](unsigned int) {
+      for(unsigned int i = nextSmallHistogram++; i < smallHistograms.size(); i = nextSmallHistogram++) {
+        const unsigned int iHistogram = smallHistograms[i];
+        const auto &range = eventRanges[iHistogram];
+        FillHistogram(sample, eventIndices.data() + range.first, eventIndices.data() + range.last, bins.data() + iHistogram*nBinsPerNode);
+      }
+    });
+
+    // Every worker fills the histogram of one chunk into its own buffer. Afterwards the buffers
+    // are added to the result in the order of the chunks, so the summation order is always the same.
+    for(auto &iHistogram : largeHistograms) {
+      const auto &range = eventRanges[iHistogram];
+      const unsigned int nChunks = GetNumberOfChunks(range.last - range.first);
+      const unsigned int nWorkers = std::max(1u, std::min(nThreads, nChunks));
+      std::vector<std::vector<Weight>> chunkBins(nWorkers, std::vector<Weight>(nBinsPerNode));
+      Weight *histogram = bins.data() + iHistogram*nBinsPerNode;
+
+      for(unsigned int iFirstChunk = 0; iFirstChunk < nChunks; iFirstChunk += nWorkers) {
+        const unsigned int nActiveWorkers = std::min(nWorkers, nChunks - iFirstChunk);
+
+        RunInParallel(nActiveWorkers, [&](unsigned int iWorker) {
+          const unsigned int iChunk = iFirstChunk + iWorker;
+          std::fill(chunkBins[iWorker].begin(), chunkBins[iWorker].end(), 0);
+          FillHistogram(sample, eventIndices.data() + GetChunkBoundary(range.first, range.last, iChunk, nChunks),
+                        eventIndices.data() + GetChunkBoundary(range.first, range.last, iChunk+1, nChunks), chunkBins[iWorker].data());
+        });
+
+        for(unsigned int iActiveWorker = 0; iActiveWorker < nActiveWorkers; ++iActiveWorker) {
+          const auto &chunk = chunkBins[iActiveWorker];
+          for(unsigned int iBin = 0; iBin < nBinsPerNode; ++iBin)
+            histogram[iBin] += chunk[iBin];
+        }
       }
     }
 
-    // Sum up Cut-PDFs to culumative Cut-PDFs
-    for(unsigned int iNode = 0; iNode < nNodes; ++iNode) {
+    Accumulate(bins);
+    return bins;
+  }
+
+  void CumulativeDistributions::Accumulate(std::vector<Weight> &bins) const {
+
+    const unsigned int nBinsPerNode = GetNBinsPerNode();
+    const unsigned int nHistograms = bins.size() / nBinsPerNode;
+
+    // Sum up Cut-PDFs to culumative Cut-PDFs, signal and background are summed up separately
+    for(unsigned int iNode = 0; iNode < nHistograms; ++iNode) {
       for(unsigned int iFeature = 0; iFeature < nFeatures; ++iFeature) {
         // Start at 2, this ignore the NaN bin at 0!
         for(unsigned int iBin = 2; iBin < nBins[iFeature]; ++iBin) {
-          unsigned int index = iNode*nBinSums[nFeatures] + nBinSums[iFeature] + iBin;
-          bins[index] += bins[index-1];
+          unsigned int index = iNode*nBinsPerNode + 2*(nBinSums[iFeature] + iBin);
+          bins[index] += bins[index-2];
+          bins[index+1] += bins[index-1];
         }
       }
     }
 
-    return bins;
   }
 
   Cut<unsigned int> Node::CalculateBestCut(const CumulativeDistributions &CDFs) const {
@@ -159,20 +879,20 @@ namespace FastBDT {
     if( currentLoss == 0 )
       return cut;
 
-    // Loop over all features and cuts and sum up signal and background histograms to cumulative histograms
+    // Loop over all features and find the best cut in the cumulative histograms of each feature,
+    // the first cut position is bin 2, this ignores the NaN bin at 0
+    const InstructionSet instructionSet = GetBestInstructionSet();
+    Weight bestGain = 0;
     for(unsigned int iFeature = 0; iFeature < nFeatures; ++iFeature) {
-      // Start at 2, this ignores the NaN bin at 0
-      for(unsigned int iCut = 2; iCut < nBins[iFeature]; ++iCut) {
-        Weight s = CDFs.GetSignal(iNode, iFeature, iCut-1);
-        Weight b = CDFs.GetBckgrd(iNode, iFeature, iCut-1);
-        Weight currentGain = currentLoss - LossFunction( signal-s, bckgrd-b ) - LossFunction( s, b );
-
-        if( cut.gain <= currentGain ) {
-          cut.gain = currentGain;
-          cut.feature = iFeature;
-          cut.index = iCut;
-          cut.valid = true;
-        }
+      if( nBins[iFeature] <= 2 )
+        continue;
+      const int bestCut = FindBestCut(&CDFs.GetSignal(iNode, iFeature, 1), nBins[iFeature] - 2,
+                                      signal, bckgrd, currentLoss, bestGain, instructionSet);
+      if( bestCut >= 0 ) {
+        cut.gain = bestGain;
+        cut.feature = iFeature;
+        cut.index = bestCut + 2;
+        cut.valid = true;
       }
     }
 
@@ -195,6 +915,12 @@ namespace FastBDT {
     square += weight*weight / original_weight;
   }
 
+  void Node::AddWeights(const Node &node) {
+    signal += node.signal;
+    bckgrd += node.bckgrd;
+    square += node.square;
+  }
+
   void Node::SetWeights(std::vector<Weight> weights) {
     signal = weights[0];
     bckgrd = weights[1];
@@ -233,16 +959,7 @@ namespace FastBDT {
   }
 
 
-  TreeBuilder::TreeBuilder(unsigned int nLayers, EventSample &sample) : nLayers(nLayers) {
-
-    const unsigned int nNodes = 1 << nLayers;
-    cuts.resize(nNodes - 1);
-
-    for(unsigned int iLayer = 0; iLayer <= nLayers; ++iLayer) {
-      for(unsigned int iNode = 0; iNode < static_cast<unsigned int>(1<<iLayer); ++iNode) {
-        nodes.push_back( Node(iLayer, iNode) );
-      }
-    }
+  TreeBuilder::TreeBuilder(unsigned int nLayers, EventSample &sample, unsigned int nThreads, bool routeOutOfBag, unsigned int maxLeaves) : nLayers(nLayers), nThreads(nThreads), maxLeaves(maxLeaves) {
 
     // The flag of every event is used for two things:
     // Firstly, a flag > 0, determines the node which holds this event at the moment
@@ -255,21 +972,249 @@ namespace FastBDT {
     // All the flags of the enabled events are set to 1 by the DecisionForest
     // prepareEventSample method. So there's no need to do this here again.
 
+    // Instead of scanning the flags of all events in every layer, the indices of the enabled events
+    // are kept in a list, which is partitioned by the nodes of the current layer, see SplitNodes.
+    const auto &flags = sample.GetFlags();
+    for(unsigned int iEvent = 0; iEvent < sample.GetNEvents(); ++iEvent) {
+      if( flags.Get(iEvent) == 1 )
+        eventIndices.push_back(iEvent);
+      else if( routeOutOfBag and flags.Get(iEvent) == 0 )
+        outOfBagIndices.push_back(iEvent);
+    }
+
+    Train(sample, routeOutOfBag);
+
+  }
+
+  TreeBuilder::TreeBuilder(unsigned int nLayers, EventSample &sample, const std::vector<unsigned int> &enabledEvents, unsigned int nThreads, bool routeOutOfBag, unsigned int maxLeaves) : nLayers(nLayers), nThreads(nThreads), maxLeaves(maxLeaves) {
+
+    const unsigned int nEvents = sample.GetNEvents();
+    for(unsigned int i = 0; i < enabledEvents.size(); ++i) {
+      if( enabledEvents[i] >= nEvents or (i > 0 and enabledEvents[i] <= enabledEvents[i-1]) )
+        throw std::runtime_error("The indices of the enabled events must be unique, sorted in ascending order and smaller than the number of events!");
+    }
+
+    // Only the flags of the enabled events are used, so only they are initialised
+    auto &flags = sample.GetFlags();
+    eventIndices = enabledEvents;
+    for(auto &iEvent : eventIndices)
+      flags.Set(iEvent, 1);
+
+    // The out-of-bag events are all the other events
+    if( routeOutOfBag ) {
+      outOfBagIndices.reserve(nEvents - eventIndices.size());
+      unsigned int iEvent = 0;
+      for(auto &iEnabled : eventIndices) {
+        for(; iEvent < iEnabled; ++iEvent)
+          outOfBagIndices.push_back(iEvent);
+        iEvent = iEnabled + 1;
+      }
+      for(; iEvent < nEvents; ++iEvent)
+        outOfBagIndices.push_back(iEvent);
+    }
+
+    Train(sample, routeOutOfBag);
+
+  }
+
+  void TreeBuilder::Train(EventSample &sample, bool routeOutOfBag) {
+
+    // Deep trees only store the nodes which are actually created, starting with the root node, see AddChildren.
+    // Otherwise all positions of the complete tree are allocated.
+    if( nLayers > maxCompleteLayers ) {
+      nodes.push_back( Node(0, 0) );
+      cuts.resize(1);
+      children.resize(1);
+    } else {
+      const unsigned int nNodes = 1 << nLayers;
+      cuts.resize(nNodes - 1);
+
+      for(unsigned int iLayer = 0; iLayer <= nLayers; ++iLayer) {
+        for(unsigned int iNode = 0; iNode < static_cast<unsigned int>(1<<iLayer); ++iNode) {
+          nodes.push_back( Node(iLayer, iNode) );
+        }
+      }
+    }
+
     // The number of signal and bckgrd events at the root node, is given by the total
     // number of signal and background in the sample.
     const auto sums = sample.GetWeights().GetSums(sample.GetNSignals());
     nodes[0].SetWeights(sums);
 
+    eventRanges.resize(nodes.size());
+    eventRanges[0] = {0, static_cast<unsigned int>(eventIndices.size())};
+    if( routeOutOfBag ) {
+      outOfBagRanges.resize(nodes.size());
+      outOfBagRanges[0] = {0, static_cast<unsigned int>(outOfBagIndices.size())};
+    }
+
+    if( maxLeaves > 0 or IsSparse() )
+      TrainNodeWise(sample, routeOutOfBag);
+    else
+      TrainDepthWise(sample, routeOutOfBag);
+
+    // An out-of-bag event belongs to the node, in whose range it is not part of the range of a child.
+    // These are the events dropped due to a NaN value, or all events if the node was not split.
+    if( routeOutOfBag ) {
+      outOfBagNodes.resize(outOfBagIndices.size());
+      for(unsigned int iNode = 0; iNode < nodes.size(); ++iNode) {
+        const auto &range = outOfBagRanges[iNode];
+        if( iNode < cuts.size() and cuts[iNode].valid ) {
+          const unsigned int iLeft = GetLeftChild(iNode);
+          std::fill(outOfBagNodes.begin() + outOfBagRanges[iLeft].last, outOfBagNodes.begin() + outOfBagRanges[iLeft + 1].first, iNode);
+        } else {
+          std::fill(outOfBagNodes.begin() + range.first, outOfBagNodes.begin() + range.last, iNode);
+        }
+      }
+    }
+
+  }
+
+  void TreeBuilder::TrainDepthWise(EventSample &sample, bool routeOutOfBag) {
+
     // The training of the tree is done level by level. So we iterate over the levels of the tree
     // and create histograms for signal and background events for different cuts, nodes and features.
+    // Only the root layer is histogrammed using all events, the distributions of the following layers
+    // are filled while the events are routed to the next layer, and completed by subtraction, see GetFilledChildren.
+    const unsigned int nBinsPerNode = 2*sample.GetValues().GetNBinSums()[sample.GetValues().GetNFeatures()];
+    CumulativeDistributions CDFs(0, sample, eventIndices, GetEventRanges(0), nThreads);
     for(unsigned int iLayer = 0; iLayer < nLayers; ++iLayer) {
 
-      CumulativeDistributions CDFs(iLayer, sample);
       UpdateCuts(CDFs, iLayer);
-      UpdateFlags(sample);
-      UpdateEvents(sample, iLayer);   
 
-    } 
+      // No histograms are needed after the last layer
+      const unsigned int nLayerNodes = 1 << iLayer;
+      std::vector<unsigned int> parents(nLayerNodes);
+      for(unsigned int iNode = 0; iNode < nLayerNodes; ++iNode)
+        parents[iNode] = nLayerNodes - 1 + iNode;
+      const bool isLastLayer = iLayer + 1 == nLayers;
+      const std::vector<int> filledChildren = isLastLayer ? std::vector<int>(nLayerNodes, -1) : GetFilledChildren(CDFs, parents);
+      std::vector<Weight> bins(isLastLayer ? 0 : 3*nLayerNodes*nBinsPerNode);
+
+      SplitNodes(sample, parents, filledChildren, bins);
+      if( routeOutOfBag )
+        RouteOutOfBag(sample, parents);
+
+      if( not isLastLayer )
+        CDFs = CumulativeDistributions(iLayer + 1, sample, CDFs, filledChildren, std::move(bins));
+
+    }
+
+  }
+
+  void TreeBuilder::TrainNodeWise(EventSample &sample, bool routeOutOfBag) {
+
+    // The leaves which can still be split, with their best cut and the cumulative distributions of their events.
+    // The children of a split node are histogrammed like in the depth-wise training, the histogram of the smaller
+    // child is filled while the events are routed, and the one of the larger child is obtained by subtraction.
+    // Hence histograms are only kept for the nodes with a valid cut, which are waiting to be split.
+    struct Candidate {
+      unsigned int iNode;
+      CumulativeDistributions CDFs;
+    };
+    std::vector<Candidate> candidates;
+
+    // Calculates the best cut of the given node, whose distributions are stored at the position iCDF in CDFs.
+    // The nodes in the last layer are never split, and nodes without a valid cut are leaves as well.
+    auto addCandidate = [&](unsigned int iNode, const CumulativeDistributions &CDFs, unsigned int iCDF) {
+      if( nodes[iNode].GetLayer() >= nLayers )
+        return;
+      Node node(CDFs.GetNNodes() == 1 ? 0 : 1, iCDF);
+      node.AddWeights(nodes[iNode]);
+      const Cut<unsigned int> cut = node.CalculateBestCut(CDFs);
+      if( cut.valid )
+        candidates.push_back({iNode, CumulativeDistributions(CDFs, iCDF)});
+      cuts[iNode] = cut;
+    };
+
+    addCandidate(0, CumulativeDistributions(0, sample, eventIndices, GetEventRanges(0), nThreads), 0);
+
+    // With a budget of leaves the candidate with the largest gain is split, until the number of leaves reaches the budget.
+    // If two candidates have the same gain, the one with the smaller position is split first.
+    // Without a budget every candidate is split, the most recent one first, so only the candidates along one path are kept.
+    const unsigned int nBinsPerNode = 2*sample.GetValues().GetNBinSums()[sample.GetValues().GetNFeatures()];
+    unsigned int nLeaves = 1;
+    while( (maxLeaves == 0 or nLeaves < maxLeaves) and not candidates.empty() ) {
+
+      unsigned int best = candidates.size() - 1;
+      if( maxLeaves > 0 ) {
+        best = 0;
+        for(unsigned int iCandidate = 1; iCandidate < candidates.size(); ++iCandidate) {
+          const auto &gain = cuts[candidates[iCandidate].iNode].gain;
+          const auto &bestGain = cuts[candidates[best].iNode].gain;
+          if( gain > bestGain or (gain == bestGain and candidates[iCandidate].iNode < candidates[best].iNode) )
+            best = iCandidate;
+        }
+      }
+      Candidate candidate = std::move(candidates[best]);
+      candidates.erase(candidates.begin() + best);
+
+      if( IsSparse() )
+        AddChildren(candidate.iNode);
+
+      // No histograms are needed for children in the last layer
+      const std::vector<unsigned int> parents = {candidate.iNode};
+      const bool isLastLayer = nodes[candidate.iNode].GetLayer() + 1 == nLayers;
+      const std::vector<int> filledChildren = isLastLayer ? std::vector<int>(1, -1) : GetFilledChildren(candidate.CDFs, parents);
+      std::vector<Weight> bins(isLastLayer ? 0 : 3*nBinsPerNode);
+
+      SplitNodes(sample, parents, filledChildren, bins);
+      if( routeOutOfBag )
+        RouteOutOfBag(sample, parents);
+      ++nLeaves;
+
+      if( not isLastLayer ) {
+        const unsigned int iLeft = GetLeftChild(candidate.iNode);
+        const CumulativeDistributions childCDFs(1, sample, candidate.CDFs, filledChildren, std::move(bins));
+        addCandidate(iLeft, childCDFs, 0);
+        addCandidate(iLeft + 1, childCDFs, 1);
+      }
+
+    }
+
+    // The leaves which were not split keep all their events
+    for(auto &candidate : candidates)
+      cuts[candidate.iNode] = Cut<unsigned int>();
+
+  }
+
+  void TreeBuilder::AddChildren(unsigned int iNode) {
+
+    const unsigned int iLeft = nodes.size();
+    const unsigned int iLayer = nodes[iNode].GetLayer() + 1;
+    children[iNode] = iLeft;
+    nodes.push_back( Node(iLayer, iLeft) );
+    nodes.push_back( Node(iLayer, iLeft + 1) );
+
+    cuts.resize(nodes.size());
+    children.resize(nodes.size());
+    eventRanges.resize(nodes.size());
+    if( not outOfBagRanges.empty() )
+      outOfBagRanges.resize(nodes.size());
+
+  }
+
+  std::vector<EventRange> TreeBuilder::GetEventRanges(unsigned int iLayer) const {
+
+    const unsigned int firstNode = (1 << iLayer) - 1;
+    return std::vector<EventRange>(eventRanges.begin() + firstNode, eventRanges.begin() + 2*firstNode + 1);
+
+  }
+
+  std::vector<int> TreeBuilder::GetFilledChildren(const CumulativeDistributions &CDFs, const std::vector<unsigned int> &parents) const {
+
+    const auto &nBins = CDFs.GetNBins();
+    std::vector<int> filledChildren(parents.size(), -1);
+    for(unsigned int iParent = 0; iParent < parents.size(); ++iParent) {
+      const auto &cut = cuts[parents[iParent]];
+      if( not cut.valid )
+        continue;
+      // The cumulative distributions contain all events of the node with a value in the bins 1, ..., iBin
+      const Weight left = CDFs.GetSignal(iParent, cut.feature, cut.index - 1) + CDFs.GetBckgrd(iParent, cut.feature, cut.index - 1);
+      const Weight total = CDFs.GetSignal(iParent, cut.feature, nBins[cut.feature] - 1) + CDFs.GetBckgrd(iParent, cut.feature, nBins[cut.feature] - 1);
+      filledChildren[iParent] = (left <= total - left) ? 0 : 1;
+    }
+    return filledChildren;
 
   }
 
@@ -282,54 +1227,229 @@ namespace FastBDT {
     }
   }
 
-  void TreeBuilder::UpdateFlags(EventSample &sample) {
+  void TreeBuilder::SplitNodes(EventSample &sample, const std::vector<unsigned int> &parents, const std::vector<int> &filledChildren, std::vector<Weight> &bins) {
 
     auto &flags = sample.GetFlags();
     const auto &values = sample.GetValues();
-    // Iterate over all signal events, and update weights in each node of the next level according to the cuts.
-    for(unsigned int iEvent = 0; iEvent < sample.GetNEvents(); ++iEvent) {
-
-      const int flag = flags.Get(iEvent);
-      if( flag <= 0)
-        continue;
-      auto &cut = cuts[flag-1];
-      if( not cut.valid )
-        continue;
-
-      const unsigned int index = values.Get(iEvent, cut.feature );
-      // If NaN value we throw out the event, but remeber its current node using the a negative flag!
-      if( index == 0 ) {
-        flags.Set(iEvent, -flag);
-      } else if( index < cut.index ) {
-        flags.Set(iEvent, flag * 2);
-      } else {
-        flags.Set(iEvent, flag * 2 + 1);
+    const auto &weights = sample.GetWeights();
+    const unsigned int nSignals = sample.GetNSignals();
+    const unsigned int nBinsPerNode = 2*values.GetNBinSums()[values.GetNFeatures()];
+    const unsigned int nParents = parents.size();
+
+    // The range of every node is split into chunks, whose number depends only on the number of events in the node.
+    // Every chunk routes its events into its own lists, node sums and histograms, which are combined in the order
+    // of the chunks afterwards. Hence the result does not depend on the number of threads.
+    struct Chunk {
+      unsigned int iParent;
+      unsigned int iNode;
+      unsigned int first;
+      unsigned int last;
+      std::vector<unsigned int> events[3]; /**< Events of the left child, dropped events and events of the right child */
+      std::vector<Node> children;
+      std::vector<Weight> bins; /**< Histograms of the filled child and of the dropped events, if the node has several chunks */
+    };
+
+    std::vector<Chunk> chunks;
+    std::vector<unsigned int> firstChunks(nParents + 1);
+    for(unsigned int iParent = 0; iParent < nParents; ++iParent) {
+      const unsigned int iNode = parents[iParent];
+      const auto &range = eventRanges[iNode];
+      const unsigned int iLayer = nodes[iNode].GetLayer();
+      firstChunks[iParent] = chunks.size();
+      const unsigned int nChunks = cuts[iNode].valid ? GetNumberOfChunks(range.last - range.first) : 1;
+      for(unsigned int iChunk = 0; iChunk < nChunks; ++iChunk) {
+        Chunk chunk;
+        chunk.iParent = iParent;
+        chunk.iNode = iNode;
+        chunk.first = GetChunkBoundary(range.first, range.last, iChunk, nChunks);
+        chunk.last = GetChunkBoundary(range.first, range.last, iChunk+1, nChunks);
+        // The weights of the children are only accumulated here, and added to the nodes of the tree in mergeChunks
+        chunk.children = {Node(iLayer + 1, 0), Node(iLayer + 1, 1)};
+        if( nChunks > 1 and filledChildren[iParent] >= 0 ) {
+          chunk.bins.resize(2*nBinsPerNode);
+        }
+        chunks.push_back(std::move(chunk));
       }
     }
-  }
+    firstChunks[nParents] = chunks.size();
+
+    // Adds the events at the end of the given list, which were added in the current block, to the histograms
+    auto fillHistogram = [&](const std::vector<unsigned int> &events, unsigned int nOldEvents, Weight *histogram) {
+      CumulativeDistributions::FillHistogram(sample, events.data() + nOldEvents, events.data() + events.size(), histogram);
+    };
+
+    auto processChunk = [&](Chunk &chunk) {
+      const auto &cut = cuts[chunk.iNode];
+      const unsigned int *indices = eventIndices.data();
+
+      // The events of a node which was not split keep the flag of this node,
+      // hence their weights are added to the node itself.
+      if( not cut.valid ) {
+        auto &node = nodes[chunk.iNode];
+        for(unsigned int i = chunk.first; i < chunk.last; ++i) {
+          const unsigned int iEvent = indices[i];
+          if( iEvent < nSignals )
+            node.AddSignalWeight( weights.Get(iEvent), weights.GetOriginal(iEvent) );
+          else
+            node.AddBckgrdWeight( weights.Get(iEvent), weights.GetOriginal(iEvent) );
+        }
+        return;
+      }
 
-  void TreeBuilder::UpdateEvents(const EventSample &sample, unsigned int iLayer) {
+      // The histograms of the filled child and of the dropped events
+      const int filledChild = filledChildren[chunk.iParent];
+      Weight *histograms[2] = {nullptr, nullptr};
+      if( filledChild >= 0 ) {
+        const unsigned int iParent = chunk.iParent;
+        if( chunk.bins.empty() ) {
+          histograms[0] = bins.data() + (2*iParent + filledChild) * nBinsPerNode;
+          histograms[1] = bins.data() + (2*nParents + iParent) * nBinsPerNode;
+        } else {
+          histograms[0] = chunk.bins.data();
+          histograms[1] = chunk.bins.data() + nBinsPerNode;
+        }
+      }
 
-    const unsigned int nNodes = (1 << iLayer);
-    const auto &weights = sample.GetWeights();
-    const auto &flags = sample.GetFlags();
+      // The events are processed in small blocks, so they are still in the cache when they are histogrammed
+      const unsigned int blockSize = 256;
+      unsigned int cutValues[blockSize];
+      const int flag = chunk.iNode + 1;
+      const int leftFlag = GetLeftChild(chunk.iNode) + 1;
+      for(unsigned int block = chunk.first; block < chunk.last; block += blockSize) {
+        const unsigned int nBlockEvents = std::min(blockSize, chunk.last - block);
+        values.GetFeatureValues(cut.feature, indices + block, indices + block + nBlockEvents, cutValues);
+        const unsigned int nOldEvents[3] = {static_cast<unsigned int>(chunk.events[0].size()), static_cast<unsigned int>(chunk.events[1].size()), static_cast<unsigned int>(chunk.events[2].size())};
+
+        for(unsigned int i = 0; i < nBlockEvents; ++i) {
+          const unsigned int iEvent = indices[block + i];
+          const unsigned int index = cutValues[i];
+          // If NaN value we throw out the event, but remeber its current node using the a negative flag!
+          if( index == 0 ) {
+            flags.Set(iEvent, -flag);
+            chunk.events[1].push_back(iEvent);
+            continue;
+          }
+          const unsigned int iChild = (index < cut.index) ? 0 : 1;
+          flags.Set(iEvent, leftFlag + iChild);
+          chunk.events[2*iChild].push_back(iEvent);
+          if( iEvent < nSignals )
+            chunk.children[iChild].AddSignalWeight( weights.Get(iEvent), weights.GetOriginal(iEvent) );
+          else
+            chunk.children[iChild].AddBckgrdWeight( weights.Get(iEvent), weights.GetOriginal(iEvent) );
+        }
 
-    for(unsigned int iEvent = 0; iEvent < sample.GetNSignals(); ++iEvent) {
-      const int flag = flags.Get(iEvent);
-      if( flag >= static_cast<int>(nNodes) ) {
-        nodes[flag-1].AddSignalWeight( weights.Get(iEvent), weights.GetOriginal(iEvent) );
+        if( filledChild >= 0 ) {
+          fillHistogram(chunk.events[2*filledChild], nOldEvents[2*filledChild], histograms[0]);
+          fillHistogram(chunk.events[1], nOldEvents[1], histograms[1]);
+        }
       }
-    }
-    for(unsigned int iEvent = sample.GetNSignals(); iEvent < sample.GetNEvents(); ++iEvent) {
-      const int flag = flags.Get(iEvent);
-      if( flag >= static_cast<int>(nNodes) ) {
-        nodes[flag-1].AddBckgrdWeight( weights.Get(iEvent), weights.GetOriginal(iEvent) );
+    };
+
+    // Combines the chunks of a node: the events of the left child are followed by the
+    // dropped events and the events of the right child, each in their original order
+    auto mergeChunks = [&](unsigned int iParent) {
+      const unsigned int iNode = parents[iParent];
+      const unsigned int iLeft = GetLeftChild(iNode);
+      const auto range = eventRanges[iNode];
+      if( not cuts[iNode].valid ) {
+        eventRanges[iLeft] = {range.last, range.last};
+        eventRanges[iLeft + 1] = {range.last, range.last};
+        return;
       }
-    }
+
+      unsigned int position = range.first;
+      unsigned int boundaries[3];
+      for(unsigned int iList = 0; iList < 3; ++iList) {
+        for(unsigned int iChunk = firstChunks[iParent]; iChunk < firstChunks[iParent + 1]; ++iChunk) {
+          const auto &events = chunks[iChunk].events[iList];
+          std::copy(events.begin(), events.end(), eventIndices.begin() + position);
+          position += events.size();
+        }
+        boundaries[iList] = position;
+      }
+      eventRanges[iLeft] = {range.first, boundaries[0]};
+      eventRanges[iLeft + 1] = {boundaries[1], boundaries[2]};
+
+      for(unsigned int iChunk = firstChunks[iParent]; iChunk < firstChunks[iParent + 1]; ++iChunk) {
+        const auto &chunk = chunks[iChunk];
+        nodes[iLeft].AddWeights(chunk.children[0]);
+        nodes[iLeft + 1].AddWeights(chunk.children[1]);
+        if( chunk.bins.empty() )
+          continue;
+        const int filledChild = filledChildren[iParent];
+        Weight *filled = bins.data() + (2*iParent + filledChild) * nBinsPerNode;
+        Weight *dropped = bins.data() + (2*nParents + iParent) * nBinsPerNode;
+        for(unsigned int iBin = 0; iBin < nBinsPerNode; ++iBin) {
+          filled[iBin] += chunk.bins[iBin];
+          dropped[iBin] += chunk.bins[nBinsPerNode + iBin];
+        }
+      }
+    };
+
+    std::atomic<unsigned int> nextChunk(0);
+    RunInParallel(std::min(nThreads, static_cast<unsigned int>(chunks.size())), [&](unsigned int) {
+      for(unsigned int iChunk = nextChunk++; iChunk < chunks.size(); iChunk = nextChunk++)
+        processChunk(chunks[iChunk]);
+    });
+
+    std::atomic<unsigned int> nextNode(0);
+    RunInParallel(std::min(nThreads, nParents), [&](unsigned int) {
+      for(unsigned int iParent = nextNode++; iParent < nParents; iParent = nextNode++)
+        mergeChunks(iParent);
+    });
 
   }
 
 
+  void TreeBuilder::RouteOutOfBag(const EventSample &sample, const std::vector<unsigned int> &parents) {
+
+    const auto &values = sample.GetValues();
+    const unsigned int nParents = parents.size();
+
+    // The out-of-bag events are only partitioned, so a node is processed by a single thread
+    std::atomic<unsigned int> nextNode(0);
+    RunInParallel(std::min(nThreads, nParents), [&](unsigned int) {
+      const unsigned int blockSize = 256;
+      unsigned int cutValues[blockSize];
+      std::vector<unsigned int> events[3];
+      for(unsigned int iParent = nextNode++; iParent < nParents; iParent = nextNode++) {
+        const unsigned int iNode = parents[iParent];
+        const unsigned int iLeft = GetLeftChild(iNode);
+        const auto range = outOfBagRanges[iNode];
+        const auto &cut = cuts[iNode];
+        if( not cut.valid ) {
+          outOfBagRanges[iLeft] = {range.last, range.last};
+          outOfBagRanges[iLeft + 1] = {range.last, range.last};
+          continue;
+        }
+
+        for(auto &list : events)
+          list.clear();
+        const unsigned int *indices = outOfBagIndices.data();
+        for(unsigned int block = range.first; block < range.last; block += blockSize) {
+          const unsigned int nBlockEvents = std::min(blockSize, range.last - block);
+          values.GetFeatureValues(cut.feature, indices + block, indices + block + nBlockEvents, cutValues);
+          for(unsigned int i = 0; i < nBlockEvents; ++i) {
+            const unsigned int index = cutValues[i];
+            const unsigned int iList = (index == 0) ? 1 : ((index < cut.index) ? 0 : 2);
+            events[iList].push_back(indices[block + i]);
+          }
+        }
+
+        unsigned int position = range.first;
+        unsigned int boundaries[3];
+        for(unsigned int iList = 0; iList < 3; ++iList) {
+          std::copy(events[iList].begin(), events[iList].end(), outOfBagIndices.begin() + position);
+          position += events[iList].size();
+          boundaries[iList] = position;
+        }
+        outOfBagRanges[iLeft] = {range.first, boundaries[0]};
+        outOfBagRanges[iLeft + 1] = {boundaries[1], boundaries[2]};
+      }
+    });
+
+  }
+
   void TreeBuilder::Print() const {
 
     std::cout << "Start Printing Tree" << std::endl;
@@ -350,7 +1470,10 @@ namespace FastBDT {
     std::cout << "Finished Printing Tree" << std::endl;
   }
 
-  ForestBuilder::ForestBuilder(EventSample &sample, unsigned int nTrees, double shrinkage, double randRatio, unsigned int nLayersPerTree, bool sPlot, double flatnessLoss) : shrinkage(shrinkage), flatnessLoss(flatnessLoss) {
+  ForestBuilder::ForestBuilder(EventSample &sample, unsigned int nTrees, double shrinkage, double randRatio, unsigned int nLayersPerTree, bool sPlot, double flatnessLoss, unsigned int nThreads, unsigned int seed, bool stratified, double gossTopFraction, unsigned int maxLeaves) : shrinkage(shrinkage), flatnessLoss(flatnessLoss), nThreads(nThreads), seed(seed), stratified(stratified), gossTopFraction(gossTopFraction), maxLeaves(maxLeaves) {
+
+    if( gossTopFraction > 0 and sPlot )
+      throw std::runtime_error("Gradient-based one-side sampling cannot be combined with the sPlot pairing of the events!");
 
     auto &weights = sample.GetWeights();
     sums = weights.GetSums(sample.GetNSignals()); 
@@ -382,36 +1505,55 @@ namespace FastBDT {
         auto nFeatures = values.GetNFeatures();
         auto nSpectators = values.GetNSpectators();
         auto &nBins = values.GetNBins();
-        auto &nBinSums = values.GetNBinSums();
         const unsigned int nEvents = sample.GetNEvents();
         const unsigned int nSignals = sample.GetNSignals();
-        uint64_t nUniformBins = 1;
-        for(unsigned int iSpectator = 0; iSpectator < nSpectators; ++iSpectator)
-            nUniformBins *= nBins[nFeatures + iSpectator];
+
+        // The uniform bin is the combination of the bins of all spectators. Most combinations of several spectators
+        // are empty, hence only the occupied combinations are numbered, in the order in which they first occur.
+        // The spectators are added one after another, so the intermediate keys never exceed nEvents times the number
+        // of bins of one spectator. The spectators never change, hence the uniform bin of every event is calculated only once.
+        unsigned int nUniformBins = 1;
+        uniform_bin_of_event.assign(nEvents, 0);
+        for(unsigned int iSpectator = 0; iSpectator < nSpectators; ++iSpectator) {
+            const uint64_t nSpectatorBins = nBins[nFeatures + iSpectator];
+            std::unordered_map<uint64_t, unsigned int> occupied_uniform_bins;
+            occupied_uniform_bins.reserve(std::min<uint64_t>(nEvents, nUniformBins * nSpectatorBins));
+            for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent) {
+                const uint64_t key = uniform_bin_of_event[iEvent] * nSpectatorBins + values.GetSpectator(iEvent, iSpectator);
+                uniform_bin_of_event[iEvent] = occupied_uniform_bins.emplace(key, occupied_uniform_bins.size()).first->second;
+            }
+            nUniformBins = occupied_uniform_bins.size();
+        }
 
         uniform_bin_weight_signal.resize(nUniformBins, 0.0);
         uniform_bin_weight_bckgrd.resize(nUniformBins, 0.0);
-        weight_below_current_F_per_uniform_bin.resize(nUniformBins, 0.0);
-        signal_event_index_sorted_by_F.resize(nSignals);
-        bckgrd_event_index_sorted_by_F.resize(nEvents-nSignals);
-
         for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent) {
-          uint64_t uniformBin = 0;
-          for(unsigned int iSpectator = 0; iSpectator < nSpectators; ++iSpectator) {
-            uniformBin += (nBinSums[nFeatures + iSpectator] - nBinSums[nFeatures]) * iSpectator + values.GetSpectator(iEvent, iSpectator);
-          } 
           if (iEvent < nSignals)
-            uniform_bin_weight_signal[uniformBin] += weights.GetOriginal(iEvent);
+            uniform_bin_weight_signal[uniform_bin_of_event[iEvent]] += weights.GetOriginal(iEvent);
           else
-            uniform_bin_weight_bckgrd[uniformBin] += weights.GetOriginal(iEvent);
+            uniform_bin_weight_bckgrd[uniform_bin_of_event[iEvent]] += weights.GetOriginal(iEvent);
         }
-        for(uint64_t iUniformBin = 0; iUniformBin < uniform_bin_weight_signal.size(); ++iUniformBin) {
+        for(unsigned int iUniformBin = 0; iUniformBin < uniform_bin_weight_signal.size(); ++iUniformBin) {
             uniform_bin_weight_signal[iUniformBin] /= sums[0];
         }
-        for(uint64_t iUniformBin = 0; iUniformBin < uniform_bin_weight_bckgrd.size(); ++iUniformBin) {
+        for(unsigned int iUniformBin = 0; iUniformBin < uniform_bin_weight_bckgrd.size(); ++iUniformBin) {
             uniform_bin_weight_bckgrd[iUniformBin] /= sums[1];
         }
 
+        signal_event_index_sorted_by_F.resize(nSignals);
+        bckgrd_event_index_sorted_by_F.resize(nEvents-nSignals);
+        for(unsigned int iEvent = 0; iEvent < nSignals; ++iEvent)
+            signal_event_index_sorted_by_F[iEvent] = {0.0, iEvent};
+        for(unsigned int iEvent = 0; iEvent < nEvents-nSignals; ++iEvent)
+            bckgrd_event_index_sorted_by_F[iEvent] = {0.0, iEvent+nSignals};
+        sort_buffer.resize(nEvents);
+
+        // Every thread tracks the uniform bins of its current chunk, see updateEventWeightsWithFlatnessPenalty
+        const unsigned int nWorkers = std::max(nThreads, 1u);
+        position_of_uniform_bin.assign(nWorkers, std::vector<unsigned int>(nUniformBins, std::numeric_limits<unsigned int>::max()));
+        weight_below_current_F_per_uniform_bin.assign(nWorkers, std::vector<double>(nUniformBins, 0.0));
+        running_weight_per_uniform_bin.assign(nUniformBins, 0.0);
+
     }
 
     // Now train config.nTrees!
@@ -425,12 +1567,21 @@ namespace FastBDT {
           updateEventWeightsWithFlatnessPenalty(sample);
 
       // Prepare the flags of the events
-      prepareEventSample( sample, randRatio, sPlot );   
+      prepareEventSample( sample, randRatio, sPlot, iTree );   
 
       // Create and train a new train on the sample
-      TreeBuilder builder(nLayersPerTree, sample);
+      // The disabled events are routed through the tree during the training, so they don't have to traverse it afterwards
+      TreeBuilder builder(nLayersPerTree, sample, enabledEvents, nThreads, randRatio < 1.0, maxLeaves);
+
+      // Undo the scaling of the gradient-based one-side sampling
+      auto &weights = sample.GetWeights();
+      for(auto &scaled : scaledOriginalWeights)
+        weights.SetOriginal(scaled.index, scaled.value);
+      scaledOriginalWeights.clear();
+
       if(builder.IsValid()) {
-        forest.push_back( Tree<unsigned int>( builder.GetCuts(), builder.GetNEntries(), builder.GetPurities(), builder.GetBoostWeights() ) );
+        forest.push_back( Tree<unsigned int>( builder.GetCuts(), builder.GetNEntries(), builder.GetPurities(), builder.GetBoostWeights(), builder.GetChildren() ) );
+        updateFCache(sample, builder, randRatio < 1.0);
       } else {
         std::cerr << "Terminated boosting at tree " << iTree << " out of " << nTrees << std::endl;
         std::cerr << "Because the last tree was not valid, meaning it couldn't find an optimal cut." << std::endl;
@@ -441,133 +1592,353 @@ namespace FastBDT {
 
   }
 
-  void ForestBuilder::prepareEventSample(EventSample &sample, double randRatio, bool sPlot) {
+  /**
+   * Counter-based random number generator, the SplitMix64 finalizer is applied to a counter.
+   * Every number depends only on the key and its position, so the numbers can be drawn in any order and by several threads.
+   */
+  static inline uint64_t SplitMix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+
+  /**
+   * Returns the uniform random number in [0, 1) at the given position of the stream with the given key
+   */
+  static inline double UniformRandom(uint64_t key, uint64_t position) {
+    return static_cast<double>(SplitMix64(key + position) >> 11) * (1.0 / 9007199254740992.0);
+  }
 
-    // Draw a random sample if stochastic gradient boost is used
-    // Draw random number [0,1) and compare it to the given ratio. If bigger disable this event by flagging it with 0.
-    // If smaller set the flag to 1. This is important! If the flags are != 1, the DecisionTree algorithm will fail.
+  void ForestBuilder::prepareEventSample(EventSample &sample, double randRatio, bool sPlot, unsigned int iTree) {
+
+    // Draw a random sample if stochastic gradient boost is used.
+    // The indices of the drawn events are collected in ascending order in enabledEvents, instead of flagging every event,
+    // the TreeBuilder only touches these events. The random number of an event (or pair) is determined by the seed,
+    // the number of the tree and its position, so the sample is independent of the number of threads.
     const unsigned int nEvents = sample.GetNEvents();
-    auto &flags = sample.GetFlags();
-    if( randRatio < 1.0 and sPlot) {
-      // For an sPlot Training it is important to take always signal and background pairs together into the training!
-      for(unsigned int iEvent = 0; iEvent < nEvents / 2 + 1; ++iEvent) {
-        int use = (static_cast<float>(rand())/static_cast<float>(RAND_MAX) > randRatio ) ? 0 : 1;
-        flags.Set(iEvent, use);
-        unsigned int jEvent = static_cast<unsigned int>(static_cast<int>(nEvents) - static_cast<int>(iEvent) - 1);
-        flags.Set(jEvent, use);
-      }
-    } else if( randRatio < 1.0) {
+    const unsigned int nSignals = sample.GetNSignals();
+    enabledEvents.resize(nEvents);
+    if( randRatio >= 1.0 ) {
       for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent)
-        flags.Set(iEvent, ( static_cast<float>(rand())/static_cast<float>(RAND_MAX) > randRatio ) ? 0 : 1 );
+        enabledEvents[iEvent] = iEvent;
+      return;
+    }
+
+    const uint64_t key = SplitMix64((static_cast<uint64_t>(seed) << 32) | iTree);
+    if( gossTopFraction > 0 ) {
+      prepareEventSampleGOSS(sample, randRatio, key);
+      return;
+    }
+
+    // For an sPlot Training it is important to take always signal and background pairs together into the training!
+    // The pair i consists of the events i and nEvents - i - 1, so the pairs are drawn instead of the events.
+    const unsigned int nCandidates = sPlot ? (nEvents + 1) / 2 : nEvents;
+    unsigned int nDrawn = 0;
+    if( stratified ) {
+      // Selection sampling draws exactly the expected number of signal and background events,
+      // in the sPlot case each pair contains a signal and background event, so the number of pairs is fixed.
+      auto select = [&](unsigned int first, unsigned int last) {
+        unsigned int nNeeded = static_cast<unsigned int>(randRatio * (last - first) + 0.5);
+        for(unsigned int i = first; i < last and nNeeded > 0; ++i) {
+          if( UniformRandom(key, i) * (last - i) < nNeeded ) {
+            enabledEvents[nDrawn++] = i;
+            --nNeeded;
+          }
+        }
+      };
+      if( sPlot ) {
+        select(0, nCandidates);
+      } else {
+        select(0, nSignals);
+        select(nSignals, nEvents);
+      }
+    } else {
+      // Every event (or pair) is drawn independently. The chunks collect their events
+      // in separate lists, which are concatenated in order afterwards.
+      const unsigned int nChunks = GetNumberOfChunks(nCandidates);
+      std::vector<std::vector<unsigned int>> chunkEvents(nChunks);
+      std::atomic<unsigned int> nextChunk(0);
+      RunInParallel(std::min(nThreads, nChunks), [&](unsigned int) {
+        for(unsigned int iChunk = nextChunk++; iChunk < nChunks; iChunk = nextChunk++) {
+          const unsigned int last = GetChunkBoundary(0, nCandidates, iChunk + 1, nChunks);
+          for(unsigned int i = GetChunkBoundary(0, nCandidates, iChunk, nChunks); i < last; ++i) {
+            if( UniformRandom(key, i) < randRatio )
+              chunkEvents[iChunk].push_back(i);
+          }
+        }
+      });
+      for(auto &events : chunkEvents) {
+        std::copy(events.begin(), events.end(), enabledEvents.begin() + nDrawn);
+        nDrawn += events.size();
+      }
+    }
+
+    // The second events of the pairs follow in reversed order, the middle event of an odd number of events is its own partner
+    if( sPlot ) {
+      const unsigned int nPairs = nDrawn;
+      for(unsigned int i = nPairs; i > 0; --i) {
+        const unsigned int jEvent = nEvents - enabledEvents[i-1] - 1;
+        if( jEvent != enabledEvents[i-1] )
+          enabledEvents[nDrawn++] = jEvent;
+      }
+    }
+    enabledEvents.resize(nDrawn);
+
+  }
+
+  void ForestBuilder::prepareEventSampleGOSS(EventSample &sample, double randRatio, uint64_t key) {
+
+    // Gradient-based one-side sampling: The events with the largest boosting weights are always used,
+    // from the remaining events only the fraction randRatio is drawn and their weights are scaled by 1 / randRatio,
+    // so the weight of the remaining events stays the same on average. The original weights are scaled,
+    // so the boost weights of the nodes stay consistent, and restored after the tree was built.
+    const unsigned int nEvents = sample.GetNEvents();
+    const unsigned int nSignals = sample.GetNSignals();
+    auto &weights = sample.GetWeights();
+
+    // Events with equal weights (e.g. all events before the first tree) are ordered randomly,
+    // using a second random stream and the index of the event, so the selection is unique
+    const unsigned int nTop = std::min(nEvents, static_cast<unsigned int>(gossTopFraction * nEvents + 0.5));
+    const uint64_t orderKey = SplitMix64(key);
+    std::vector<unsigned int> order(nEvents);
+    for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent)
+      order[iEvent] = iEvent;
+    std::nth_element(order.begin(), order.begin() + nTop, order.end(), [&](unsigned int a, unsigned int b) {
+      const Weight wa = std::abs(weights.GetWithoutOriginal(a));
+      const Weight wb = std::abs(weights.GetWithoutOriginal(b));
+      if( wa != wb )
+        return wa > wb;
+      const uint64_t ra = SplitMix64(orderKey + a);
+      const uint64_t rb = SplitMix64(orderKey + b);
+      return ra < rb or (ra == rb and a < b);
+    });
+    std::vector<bool> isTop(nEvents, false);
+    for(unsigned int i = 0; i < nTop; ++i)
+      isTop[order[i]] = true;
+
+    // The remaining events are drawn independently or, if stratified, by selection sampling
+    // of exactly the fraction randRatio of the remaining signal and background events
+    std::vector<bool> isDrawn(nEvents, false);
+    if( stratified ) {
+      auto select = [&](unsigned int first, unsigned int last) {
+        unsigned int nRemaining = 0;
+        for(unsigned int iEvent = first; iEvent < last; ++iEvent)
+          nRemaining += isTop[iEvent] ? 0 : 1;
+        unsigned int nNeeded = static_cast<unsigned int>(std::min(1.0, randRatio) * nRemaining + 0.5);
+        for(unsigned int iEvent = first; iEvent < last and nNeeded > 0; ++iEvent) {
+          if( isTop[iEvent] )
+            continue;
+          if( UniformRandom(key, iEvent) * nRemaining < nNeeded ) {
+            isDrawn[iEvent] = true;
+            --nNeeded;
+          }
+          --nRemaining;
+        }
+      };
+      select(0, nSignals);
+      select(nSignals, nEvents);
     } else {
       for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent)
-        flags.Set(iEvent, 1);
+        isDrawn[iEvent] = not isTop[iEvent] and UniformRandom(key, iEvent) < randRatio;
+    }
+
+    enabledEvents.clear();
+    const double scale = 1.0 / std::min(1.0, randRatio);
+    for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent) {
+      if( isTop[iEvent] ) {
+        enabledEvents.push_back(iEvent);
+      } else if( isDrawn[iEvent] ) {
+        enabledEvents.push_back(iEvent);
+        scaledOriginalWeights.push_back({weights.GetOriginal(iEvent), iEvent});
+        weights.SetOriginal(iEvent, weights.GetOriginal(iEvent) * scale);
+      }
     }
 
   }
 
-  void ForestBuilder::updateEventWeights(EventSample &eventSample) {
+  void ForestBuilder::updateFCache(const EventSample &eventSample, const TreeBuilder &builder, bool calculateOutOfBagLoss) {
 
-    const unsigned int nEvents = eventSample.GetNEvents();
     const unsigned int nSignals = eventSample.GetNSignals();
-
     const auto &flags = eventSample.GetFlags();
-    const auto &values = eventSample.GetValues();
-    auto &weights = eventSample.GetWeights();
+    const auto &weights = eventSample.GetWeights();
+    const auto &tree = forest.back();
 
-    // Loop over all events and update FCache
     // If the event wasn't disabled, we can use the flag directly to determine the node of this event
-    // If not we have to calculate the node to which this event belongs
-    if( forest.size() > 0 ) {
-      for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent) {
-        if( flags.Get(iEvent) != 0)
-          FCache[iEvent] += shrinkage*forest.back().GetBoostWeight( std::abs(flags.Get(iEvent)) - 1);
-        else
-          FCache[iEvent] += shrinkage*forest.back().GetBoostWeight( forest.back().ValueToNode(&values.Get(iEvent)) );
+    const unsigned int nEnabled = enabledEvents.size();
+    const unsigned int nChunks = GetNumberOfChunks(nEnabled);
+    std::atomic<unsigned int> nextChunk(0);
+    RunInParallel(std::min(nThreads, nChunks), [&](unsigned int) {
+      for(unsigned int iChunk = nextChunk++; iChunk < nChunks; iChunk = nextChunk++) {
+        const unsigned int last = GetChunkBoundary(0, nEnabled, iChunk + 1, nChunks);
+        for(unsigned int i = GetChunkBoundary(0, nEnabled, iChunk, nChunks); i < last; ++i) {
+          const unsigned int iEvent = enabledEvents[i];
+          FCache[iEvent] += shrinkage*tree.GetBoostWeight( std::abs(flags.Get(iEvent)) - 1);
+        }
       }
+    });
+
+    // The disabled events were routed by the TreeBuilder. As they were not used for the training of the tree,
+    // their binomial deviance log(1 + exp(-2yF)), averaged with their original weights, is an estimate of the loss.
+    // The partial sums of the chunks are added in order, so the loss does not depend on the number of threads.
+    const auto &outOfBagIndices = builder.GetOutOfBagIndices();
+    const auto &outOfBagNodes = builder.GetOutOfBagNodes();
+    const unsigned int nOutOfBag = outOfBagIndices.size();
+    const unsigned int nOutOfBagChunks = GetNumberOfChunks(nOutOfBag);
+    std::vector<double> lossSums(nOutOfBagChunks, 0.0);
+    std::vector<double> weightSums(nOutOfBagChunks, 0.0);
+    std::atomic<unsigned int> nextOutOfBagChunk(0);
+    RunInParallel(std::min(nThreads, nOutOfBagChunks), [&](unsigned int) {
+      for(unsigned int iChunk = nextOutOfBagChunk++; iChunk < nOutOfBagChunks; iChunk = nextOutOfBagChunk++) {
+        const unsigned int last = GetChunkBoundary(0, nOutOfBag, iChunk + 1, nOutOfBagChunks);
+        for(unsigned int i = GetChunkBoundary(0, nOutOfBag, iChunk, nOutOfBagChunks); i < last; ++i) {
+          const unsigned int iEvent = outOfBagIndices[i];
+          FCache[iEvent] += shrinkage*tree.GetBoostWeight(outOfBagNodes[i]);
+          const double margin = (iEvent < nSignals) ? -2.0*FCache[iEvent] : 2.0*FCache[iEvent];
+          const double deviance = (margin > 0) ? margin + std::log1p(std::exp(-margin)) : std::log1p(std::exp(margin));
+          lossSums[iChunk] += weights.GetOriginal(iEvent) * deviance;
+          weightSums[iChunk] += weights.GetOriginal(iEvent);
+        }
+      }
+    });
+
+    if( calculateOutOfBagLoss ) {
+      double lossSum = 0;
+      double weightSum = 0;
+      for(unsigned int iChunk = 0; iChunk < nOutOfBagChunks; ++iChunk) {
+        lossSum += lossSums[iChunk];
+        weightSum += weightSums[iChunk];
+      }
+      // A sample which contains every event (e.g. gradient-based one-side sampling of all events) leaves nothing to average
+      if( weightSum > 0 )
+        outOfBagLoss.push_back(lossSum / weightSum);
     }
 
-    for(unsigned int iEvent = 0; iEvent < nSignals; ++iEvent)
-      weights.Set(iEvent, 2.0/(1.0+std::exp(2.0*FCache[iEvent])));
-    for(unsigned int iEvent = nSignals; iEvent < nEvents; ++iEvent)
-      weights.Set(iEvent, 2.0/(1.0+std::exp(-2.0*FCache[iEvent])));
-
   }
-  
-  void ForestBuilder::updateEventWeightsWithFlatnessPenalty(EventSample &eventSample) {
+
+  void ForestBuilder::updateEventWeights(EventSample &eventSample) {
 
     const unsigned int nEvents = eventSample.GetNEvents();
     const unsigned int nSignals = eventSample.GetNSignals();
 
-    const auto &values = eventSample.GetValues();
     auto &weights = eventSample.GetWeights();
 
-    auto &nBinSums = values.GetNBinSums();
-    auto nFeatures = values.GetNFeatures();
-    auto nSpectators = values.GetNSpectators();
-    
-    // Sort events in order of increasing F Value
-    for(unsigned int iEvent = 0; iEvent < nSignals; ++iEvent) {
-        signal_event_index_sorted_by_F[iEvent] = {FCache[iEvent], iEvent};
-    }
-    for(unsigned int iEvent = 0; iEvent < nEvents-nSignals; ++iEvent) {
-        bckgrd_event_index_sorted_by_F[iEvent] = {-FCache[iEvent], iEvent+nSignals};
-    }
-
-    {
-        auto first = signal_event_index_sorted_by_F.begin();
-        auto last = signal_event_index_sorted_by_F.end();
-        std::sort(first, last, compareWithIndex<double>);
-    }
-    
-    {
-        auto first = bckgrd_event_index_sorted_by_F.begin();
-        auto last = bckgrd_event_index_sorted_by_F.end();
-        std::sort(first, last, compareWithIndex<double>);
-    }
-
-    double global_weight_below_current_F = 0;
-    for(unsigned int iIndex = 0; iIndex < signal_event_index_sorted_by_F.size(); ++iIndex) {
-        unsigned int iEvent = signal_event_index_sorted_by_F[iIndex].index;
-
-        uint64_t uniformBin = 0;
-        for(unsigned int iSpectator = 0; iSpectator < nSpectators; ++iSpectator) {
-          uniformBin += (nBinSums[nFeatures + iSpectator] - nBinSums[nFeatures]) * iSpectator + values.GetSpectator(iEvent, iSpectator);
-        }
+    // Every event is updated independently, so the events are processed in chunks by all threads
+    const unsigned int nChunks = GetNumberOfChunks(nEvents);
+    std::atomic<unsigned int> nextChunk(0);
+    RunInParallel(std::min(nThreads, nChunks), [&](unsigned int) {
+      std::vector<Weight> chunkWeights;
+      for(unsigned int iChunk = nextChunk++; iChunk < nChunks; iChunk = nextChunk++) {
+        const unsigned int first = GetChunkBoundary(0, nEvents, iChunk, nChunks);
+        const unsigned int last = GetChunkBoundary(0, nEvents, iChunk + 1, nChunks);
+        const unsigned int firstBckgrd = std::max(first, std::min(last, nSignals));
+        chunkWeights.resize(last - first);
+        CalculateBoostWeights(FCache.data() + first, firstBckgrd - first, 2.0, chunkWeights.data());
+        CalculateBoostWeights(FCache.data() + firstBckgrd, last - firstBckgrd, -2.0, chunkWeights.data() + (firstBckgrd - first));
+        for(unsigned int iEvent = first; iEvent < last; ++iEvent)
+          weights.Set(iEvent, chunkWeights[iEvent - first]);
+      }
+    });
 
-        weight_below_current_F_per_uniform_bin[uniformBin] += weights.GetOriginal(iEvent);
-        global_weight_below_current_F += weights.GetOriginal(iEvent);
+  }
+  
+  void ForestBuilder::updateEventWeightsWithFlatnessPenalty(EventSample &eventSample) {
 
-        double F = global_weight_below_current_F / sums[0];
-        double F_bin = weight_below_current_F_per_uniform_bin[uniformBin] / (uniform_bin_weight_signal[uniformBin] * sums[0]);
+    auto &weights = eventSample.GetWeights();
 
-        weights.Set(iEvent, weights.GetWithoutOriginal(iEvent) - flatnessLoss * (F_bin - F));
+    // Sort events in order of increasing F Value (decreasing for background events).
+    // The order of the previous boosting step is kept, and only the F values are updated.
+    // One tree changes F only a little, so the previous order consists of few ascending runs, which are merged
+    for(auto &event : signal_event_index_sorted_by_F) {
+        event.value = FCache[event.index];
     }
-
-    for(uint64_t iUniformBin = 0; iUniformBin < weight_below_current_F_per_uniform_bin.size(); ++iUniformBin) {
-        weight_below_current_F_per_uniform_bin[iUniformBin] = 0.0;
+    for(auto &event : bckgrd_event_index_sorted_by_F) {
+        event.value = -FCache[event.index];
     }
-    
-    global_weight_below_current_F = 0;
-    for(unsigned int iIndex = 0; iIndex < bckgrd_event_index_sorted_by_F.size(); ++iIndex) {
-        unsigned int iEvent = bckgrd_event_index_sorted_by_F[iIndex].index;
-
-        uint64_t uniformBin = 0;
-        for(unsigned int iSpectator = 0; iSpectator < nSpectators; ++iSpectator) {
-          uniformBin += (nBinSums[nFeatures + iSpectator] - nBinSums[nFeatures]) * iSpectator + values.GetSpectator(iEvent, iSpectator);
+    const unsigned int nSignals = signal_event_index_sorted_by_F.size();
+    const unsigned int nBckgrds = bckgrd_event_index_sorted_by_F.size();
+    RunInParallel(std::min(nThreads, 2u), [&](unsigned int iThread) {
+      if(iThread == 0)
+        SortAlmostSorted(signal_event_index_sorted_by_F.data(), signal_event_index_sorted_by_F.data() + nSignals, sort_buffer.data());
+      if(iThread == 1 or nThreads < 2)
+        SortAlmostSorted(bckgrd_event_index_sorted_by_F.data(), bckgrd_event_index_sorted_by_F.data() + nBckgrds, sort_buffer.data() + nSignals);
+    });
+
+    // The penalty of an event depends on the weight below its F value, globally and in its uniform bin.
+    // The sorted events are split into chunks, and every chunk sums up its weight globally and per uniform bin.
+    // Only the uniform bins occurring in a chunk are stored, so the memory scales with the number of events
+    // and not with the number of uniform bins. These sums are merged into the prefix of every chunk,
+    // afterwards the chunks are processed in parallel, each one keeping its own running weights.
+    // The arrays per uniform bin are allocated once, and only the entries of the occurring uniform bins are reset.
+    // The result does not depend on the number of threads.
+    const unsigned int nWorkers = position_of_uniform_bin.size();
+
+    for(unsigned int iClass = 0; iClass < 2; ++iClass) {
+      const auto &sorted = (iClass == 0) ? signal_event_index_sorted_by_F : bckgrd_event_index_sorted_by_F;
+      const auto &uniform_bin_weight = (iClass == 0) ? uniform_bin_weight_signal : uniform_bin_weight_bckgrd;
+      const double sum = sums[iClass];
+      const unsigned int nSorted = sorted.size();
+      const unsigned int nChunks = GetNumberOfChunks(nSorted);
+
+      // Weight of all events before every chunk, and the uniform bins occurring in every chunk with their weight,
+      // which is replaced by the weight of the uniform bin before the chunk once the prefixes are merged
+      std::vector<double> chunk_weight_below_current_F(nChunks + 1, 0.0);
+      std::vector<std::vector<std::pair<unsigned int, double>>> chunk_weight_per_uniform_bin(nChunks);
+
+      std::atomic<unsigned int> nextChunk(0);
+      RunInParallel(std::min(nWorkers, nChunks), [&](unsigned int iThread) {
+        auto &position = position_of_uniform_bin[iThread];
+        for(unsigned int iChunk = nextChunk++; iChunk < nChunks; iChunk = nextChunk++) {
+          auto &chunk_weight = chunk_weight_per_uniform_bin[iChunk];
+          for(unsigned int iIndex = GetChunkBoundary(0, nSorted, iChunk, nChunks); iIndex < GetChunkBoundary(0, nSorted, iChunk + 1, nChunks); ++iIndex) {
+            const unsigned int iEvent = sorted[iIndex].index;
+            const unsigned int uniformBin = uniform_bin_of_event[iEvent];
+            if(position[uniformBin] == std::numeric_limits<unsigned int>::max()) {
+              position[uniformBin] = chunk_weight.size();
+              chunk_weight.emplace_back(uniformBin, 0.0);
+            }
+            chunk_weight_below_current_F[iChunk + 1] += weights.GetOriginal(iEvent);
+            chunk_weight[position[uniformBin]].second += weights.GetOriginal(iEvent);
+          }
+          for(auto &entry : chunk_weight)
+            position[entry.first] = std::numeric_limits<unsigned int>::max();
         }
-
-        weight_below_current_F_per_uniform_bin[uniformBin] += weights.GetOriginal(iEvent);
-        global_weight_below_current_F += weights.GetOriginal(iEvent);
-
-        double F = global_weight_below_current_F / sums[1];
-        double F_bin = weight_below_current_F_per_uniform_bin[uniformBin] / (uniform_bin_weight_bckgrd[uniformBin] * sums[1]);
-
-        weights.Set(iEvent, weights.GetWithoutOriginal(iEvent) - flatnessLoss * (F_bin - F));
-    }
-
-    for(uint64_t iUniformBin = 0; iUniformBin < weight_below_current_F_per_uniform_bin.size(); ++iUniformBin) {
-        weight_below_current_F_per_uniform_bin[iUniformBin] = 0.0;
+      });
+
+      for(unsigned int iChunk = 0; iChunk < nChunks; ++iChunk) {
+        chunk_weight_below_current_F[iChunk + 1] += chunk_weight_below_current_F[iChunk];
+        for(auto &entry : chunk_weight_per_uniform_bin[iChunk]) {
+          const double weight = entry.second;
+          entry.second = running_weight_per_uniform_bin[entry.first];
+          running_weight_per_uniform_bin[entry.first] += weight;
+        }
+      }
+      for(auto &chunk_weight : chunk_weight_per_uniform_bin)
+        for(auto &entry : chunk_weight)
+          running_weight_per_uniform_bin[entry.first] = 0.0;
+
+      nextChunk = 0;
+      RunInParallel(std::min(nWorkers, nChunks), [&](unsigned int iThread) {
+        auto &weight_below_current_F = weight_below_current_F_per_uniform_bin[iThread];
+        for(unsigned int iChunk = nextChunk++; iChunk < nChunks; iChunk = nextChunk++) {
+          // Only the uniform bins occurring in this chunk are read, so the others do not need to be reset
+          for(auto &entry : chunk_weight_per_uniform_bin[iChunk])
+            weight_below_current_F[entry.first] = entry.second;
+          double weight_below_current_F_global = chunk_weight_below_current_F[iChunk];
+          for(unsigned int iIndex = GetChunkBoundary(0, nSorted, iChunk, nChunks); iIndex < GetChunkBoundary(0, nSorted, iChunk + 1, nChunks); ++iIndex) {
+            const unsigned int iEvent = sorted[iIndex].index;
+            const unsigned int uniformBin = uniform_bin_of_event[iEvent];
+
+            weight_below_current_F_global += weights.GetOriginal(iEvent);
+            weight_below_current_F[uniformBin] += weights.GetOriginal(iEvent);
+
+            double F = weight_below_current_F_global / sum;
+            double F_bin = weight_below_current_F[uniformBin] / (uniform_bin_weight[uniformBin] * sum);
+
+            weights.Set(iEvent, weights.GetWithoutOriginal(iEvent) - flatnessLoss * (F_bin - F));
+          }
+        }
+      });
     }
 
   }
@@ -28,6 +28,13 @@ extern "C" {
     void SetPurityTransformation(void *ptr, bool* purityTransformation, unsigned int size) {
       reinterpret_cast<Expertise*>(ptr)->classifier.SetPurityTransformation(std::vector<bool>(purityTransformation, purityTransformation + size));
     }
+
+    void SetBinningStrategy(void *ptr, unsigned int* binningStrategy, unsigned int size) {
+      std::vector<BinningStrategy> strategies;
+      for(unsigned int i = 0; i < size; ++i)
+        strategies.push_back(static_cast<BinningStrategy>(binningStrategy[i]));
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetBinningStrategy(strategies);
+    }
     
     void SetNTrees(void *ptr, unsigned int nTrees) {
       reinterpret_cast<Expertise*>(ptr)->classifier.SetNTrees(nTrees);
@@ -92,6 +99,70 @@ extern "C" {
     bool GetSPlot(void *ptr) {
       return reinterpret_cast<Expertise*>(ptr)->classifier.GetSPlot();
     }
+    
+    void SetNThreads(void *ptr, unsigned int nThreads) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetNThreads(nThreads);
+    }
+
+    unsigned int GetNThreads(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetNThreads();
+    }
+    
+    void SetColumnMajor(void *ptr, bool columnMajor) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetColumnMajor(columnMajor);
+    }
+
+    bool GetColumnMajor(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetColumnMajor();
+    }
+
+    void SetHistogramTileSize(void *ptr, unsigned int histogramTileSize) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetHistogramTileSize(histogramTileSize);
+    }
+
+    unsigned int GetHistogramTileSize(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetHistogramTileSize();
+    }
+
+    void SetSeed(void *ptr, unsigned int seed) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetSeed(seed);
+    }
+
+    unsigned int GetSeed(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetSeed();
+    }
+
+    void SetStratifiedSubsample(void *ptr, bool stratifiedSubsample) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetStratifiedSubsample(stratifiedSubsample);
+    }
+
+    bool GetStratifiedSubsample(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetStratifiedSubsample();
+    }
+
+    void SetGOSSTopFraction(void *ptr, double gossTopFraction) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetGOSSTopFraction(gossTopFraction);
+    }
+
+    double GetGOSSTopFraction(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetGOSSTopFraction();
+    }
+
+    void SetAggregateDuplicates(void *ptr, bool aggregateDuplicates) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetAggregateDuplicates(aggregateDuplicates);
+    }
+
+    bool GetAggregateDuplicates(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetAggregateDuplicates();
+    }
+
+    void SetMaxLeaves(void *ptr, unsigned int maxLeaves) {
+      reinterpret_cast<Expertise*>(ptr)->classifier.SetMaxLeaves(maxLeaves);
+    }
+
+    unsigned int GetMaxLeaves(void *ptr) {
+      return reinterpret_cast<Expertise*>(ptr)->classifier.GetMaxLeaves();
+    }
 
     void Delete(void *ptr) {
       delete reinterpret_cast<Expertise*>(ptr);
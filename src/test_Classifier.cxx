@@ -13,6 +13,8 @@
 
 #include <algorithm>
 #include <random>
+#include <functional>
+#include <string>
 
 using namespace FastBDT;
 
@@ -153,6 +155,169 @@ TEST_F(ClassifierTest, SubsamplingChangesResult) {
 
 }
 
+TEST_F(ClassifierTest, SeedDeterminesSubsampling) {
+
+    FastBDT::Classifier classifier1(5, 3, {4, 4, 4, 4}, 0.1, 0.5);
+    classifier1.SetSeed(42);
+    classifier1.fit(X, y, w);
+    
+    FastBDT::Classifier classifier2(5, 3, {4, 4, 4, 4}, 0.1, 0.5);
+    classifier2.SetSeed(42);
+    classifier2.fit(X, y, w);
+
+    FastBDT::Classifier classifier3(5, 3, {4, 4, 4, 4}, 0.1, 0.5);
+    classifier3.SetSeed(43);
+    classifier3.fit(X, y, w);
+
+    EXPECT_EQ(classifier1.GetSeed(), 42u);
+    EXPECT_EQ(GetIrisScore(classifier1), GetIrisScore(classifier2));
+    EXPECT_EQ(classifier1.GetOutOfBagLoss(), classifier2.GetOutOfBagLoss());
+    EXPECT_NE(GetIrisScore(classifier1), GetIrisScore(classifier3));
+
+}
+
+TEST_F(ClassifierTest, StratifiedSubsamplingWorks) {
+
+    for(bool sPlot : {false, true}) {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.5, sPlot);
+        classifier.SetSeed(42);
+        classifier.SetStratifiedSubsample(true);
+        classifier.fit(X, y, w);
+
+        EXPECT_EQ(classifier.GetStratifiedSubsample(), true);
+        EXPECT_GT(GetIrisScore(classifier), -10.0);
+        EXPECT_EQ(classifier.GetOutOfBagLoss().size(), 10u);
+    }
+
+}
+
+TEST_F(ClassifierTest, GOSSSamplingWorks) {
+
+    for(bool stratified : {false, true}) {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.3);
+        classifier.SetSeed(42);
+        classifier.SetGOSSTopFraction(0.2);
+        classifier.SetStratifiedSubsample(stratified);
+        classifier.fit(X, y, w);
+
+        EXPECT_DOUBLE_EQ(classifier.GetGOSSTopFraction(), 0.2);
+        EXPECT_GT(GetIrisScore(classifier), -10.0);
+    }
+
+    FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.3, true);
+    classifier.SetGOSSTopFraction(0.2);
+    EXPECT_THROW(classifier.fit(X, y, w), std::runtime_error);
+
+}
+
+TEST_F(ClassifierTest, AggregatingDuplicatesGivesSameResult) {
+
+    // Every event appears twice, so aggregation at least halves the number of events
+    std::vector<std::vector<float>> X2 = X;
+    for(auto &feature : X2)
+        feature.insert(feature.end(), feature.begin(), feature.end());
+    std::vector<bool> y2 = y;
+    y2.insert(y2.end(), y.begin(), y.end());
+    std::vector<float> w2 = w;
+    w2.insert(w2.end(), w.begin(), w.end());
+
+    FastBDT::Classifier classifier1(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier1.fit(X2, y2, w2);
+
+    FastBDT::Classifier classifier2(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier2.SetAggregateDuplicates(true);
+    classifier2.fit(X2, y2, w2);
+
+    EXPECT_EQ(classifier2.GetAggregateDuplicates(), true);
+    EXPECT_NEAR(GetIrisScore(classifier1), GetIrisScore(classifier2), 1e-3);
+
+    FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0, true);
+    classifier.SetAggregateDuplicates(true);
+    EXPECT_THROW(classifier.fit(X, y, w), std::runtime_error);
+
+}
+
+TEST_F(ClassifierTest, BestFirstGrowthWorks) {
+
+    FastBDT::Classifier classifier1(10, 6, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier1.SetMaxLeaves(6);
+    classifier1.fit(X, y, w);
+    EXPECT_EQ(classifier1.GetMaxLeaves(), 6u);
+    EXPECT_GT(GetIrisScore(classifier1), -10.0);
+
+    // The irregular trees are stored with the classifier
+    std::stringstream stream;
+    stream << classifier1 << std::endl;
+    FastBDT::Classifier classifier3(stream);
+    EXPECT_EQ(GetIrisScore(classifier1), GetIrisScore(classifier3));
+
+    FastBDT::Classifier classifier4(10, 6, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier4.SetMaxLeaves(1);
+    EXPECT_THROW(classifier4.fit(X, y, w), std::runtime_error);
+
+}
+
+TEST_F(ClassifierTest, DeepTreesWork) {
+
+    FastBDT::Classifier classifier1(10, 14, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier1.fit(X, y, w);
+    EXPECT_GT(GetIrisScore(classifier1), -10.0);
+
+    // The compact trees are stored with the classifier
+    std::stringstream stream;
+    stream << classifier1 << std::endl;
+    FastBDT::Classifier classifier2(stream);
+    EXPECT_EQ(GetIrisScore(classifier1), GetIrisScore(classifier2));
+
+}
+
+TEST_F(ClassifierTest, ColumnMajorLayoutDoesNotChangeResult) {
+
+    FastBDT::Classifier classifier1(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier1.fit(X, y, w);
+    
+    FastBDT::Classifier classifier2(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier2.SetColumnMajor(true);
+    classifier2.fit(X, y, w);
+
+    EXPECT_EQ(classifier2.GetColumnMajor(), true);
+    EXPECT_EQ(GetIrisScore(classifier1), GetIrisScore(classifier2));
+
+}
+
+TEST_F(ClassifierTest, HistogramTileSizeDoesNotChangeResult) {
+
+    FastBDT::Classifier classifier1(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier1.fit(X, y, w);
+    
+    FastBDT::Classifier classifier2(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier2.SetHistogramTileSize(1);
+    classifier2.fit(X, y, w);
+
+    EXPECT_EQ(classifier2.GetHistogramTileSize(), 1u);
+    EXPECT_EQ(GetIrisScore(classifier1), GetIrisScore(classifier2));
+
+}
+
+TEST_F(ClassifierTest, OutOfBagLossIsCalculatedForSubsampling) {
+
+    FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.5);
+    classifier.fit(X, y, w);
+    const auto &loss = classifier.GetOutOfBagLoss();
+    EXPECT_EQ(loss.size(), 10u);
+    for(auto &l : loss) {
+        EXPECT_TRUE(std::isfinite(l));
+        EXPECT_GT(l, 0.0);
+    }
+    // The boosting reduces the loss of the unseen events on this easy problem
+    EXPECT_LT(loss.back(), loss.front());
+
+    FastBDT::Classifier classifier2(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier2.fit(X, y, w);
+    EXPECT_TRUE(classifier2.GetOutOfBagLoss().empty());
+
+}
+
 TEST_F(ClassifierTest, GetFeatureMaping) {
 
     FastBDT::Classifier classifier(1, 5, {4, 4, 4, 4}, 0.1, 0.5);
@@ -169,6 +334,227 @@ TEST_F(ClassifierTest, GetFeatureMaping) {
 
 }
 
+TEST_F(ClassifierTest, PurityTransformationWithDifferentBinningsWorks) {
+
+    FastBDT::Classifier classifier(10, 3, {3, 5, 4, 2}, 0.1, 1.0);
+    classifier.SetPurityTransformation({true, true, false, true});
+    classifier.fit(X, y, w);
+
+    EXPECT_EQ(classifier.GetBinning(), std::vector<unsigned int>({3, 3, 5, 5, 4, 2, 2}));
+    EXPECT_GT(GetIrisScore(classifier), -10.0);
+
+}
+
+TEST_F(ClassifierTest, FeatureBinningIsCalculatedFromTheTrainingData) {
+
+    // Use enough events, so that the events are encoded in several chunks by several threads
+    const unsigned int numberOfEvents = 200000;
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution(0.0f, 1.0f);
+    std::vector<std::vector<float>> X2(3, std::vector<float>(numberOfEvents));
+    std::vector<bool> y2(numberOfEvents);
+    std::vector<float> w2(numberOfEvents);
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        y2[i] = i % 2 == 0;
+        for(auto &feature : X2)
+            feature[i] = distribution(generator) + (y2[i] ? 0.5f : 0.0f);
+        w2[i] = 1.0f + 0.1f * (i % 7);
+    }
+
+    using FastBDT::BinningStrategy;
+    FastBDT::Classifier classifier(1, 2, {4, 5, 3}, 0.1, 1.0);
+    classifier.SetBinningStrategy({BinningStrategy::Quantile, BinningStrategy::Weighted, BinningStrategy::Equidistant});
+    classifier.SetPurityTransformation({true, false, true});
+    classifier.SetNThreads(4);
+    classifier.fit(X2, y2, w2);
+
+    // Every feature is binned with its own number of levels and strategy
+    const auto &featureBinning = classifier.GetFeatureBinning();
+    ASSERT_EQ(featureBinning.size(), 3u);
+    std::vector<float> feature = X2[0];
+    EXPECT_EQ(featureBinning[0].GetBinning(), FeatureBinning<float>(4, feature).GetBinning());
+    feature = X2[1];
+    std::vector<float> weights = w2;
+    EXPECT_EQ(featureBinning[1].GetBinning(), WeightedFeatureBinning<float>(5, feature, weights).GetBinning());
+    feature = X2[2];
+    EXPECT_EQ(featureBinning[2].GetBinning(), EquidistantFeatureBinning<float>(3, feature).GetBinning());
+    EXPECT_EQ(classifier.GetBinning(), std::vector<unsigned int>({4, 4, 5, 3, 3}));
+
+}
+
+TEST_F(ClassifierTest, BinningStrategyWorks) {
+
+    using FastBDT::BinningStrategy;
+    FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier.SetBinningStrategy({BinningStrategy::Equidistant, BinningStrategy::Weighted, BinningStrategy::Quantile, BinningStrategy::Equidistant});
+    classifier.SetPurityTransformation({true, false, false, false});
+    classifier.fit(X, y, w);
+    float score1 = GetIrisScore(classifier);
+    EXPECT_GT(score1, -10.0);
+
+    // Only the equidistant features use the direct lookup, their boundaries divide the range of the feature into equal bins
+    const auto &featureBinning = classifier.GetFeatureBinning();
+    EXPECT_TRUE(featureBinning[0].IsEquidistant());
+    EXPECT_FALSE(featureBinning[1].IsEquidistant());
+    EXPECT_FALSE(featureBinning[2].IsEquidistant());
+    EXPECT_TRUE(featureBinning[3].IsEquidistant());
+    std::vector<float> boundaries = featureBinning[0].GetBinning();
+    std::sort(boundaries.begin(), boundaries.end());
+    EXPECT_FLOAT_EQ(boundaries.front(), *std::min_element(X[0].begin(), X[0].end()));
+    EXPECT_FLOAT_EQ(boundaries.back(), *std::max_element(X[0].begin(), X[0].end()));
+    for(unsigned int iBin = 1; iBin < boundaries.size(); ++iBin)
+        EXPECT_NEAR(boundaries[iBin] - boundaries[iBin-1], (boundaries.back() - boundaries.front()) / 16, 1e-5);
+
+    // The strategy is stored with the classifier
+    std::stringstream stream;
+    stream << classifier << std::endl;
+    FastBDT::Classifier classifier2(stream);
+    EXPECT_EQ(classifier2.GetBinningStrategy(), classifier.GetBinningStrategy());
+    EXPECT_FLOAT_EQ(score1, GetIrisScore(classifier2));
+
+    // Loading into an already configured classifier replaces its strategy
+    FastBDT::Classifier configured(10, 3, {4, 4}, 0.1, 1.0);
+    configured.SetBinningStrategy({BinningStrategy::Weighted, BinningStrategy::Weighted});
+    std::stringstream stream2;
+    stream2 << classifier << std::endl;
+    configured = FastBDT::Classifier(stream2);
+    EXPECT_EQ(configured.GetBinningStrategy(), classifier.GetBinningStrategy());
+
+    FastBDT::Classifier classifier3(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    classifier3.SetBinningStrategy({BinningStrategy::Equidistant});
+    EXPECT_THROW(classifier3.fit(X, y, w), std::runtime_error);
+
+}
+
+TEST_F(ClassifierTest, FlatnessLossWorks) {
+
+    // The last features are used as flatness features (spectators),
+    // with two of them only two features remain for the classification
+    for(unsigned int nFlatnessFeatures : {1u, 2u}) {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0, false, 1.0, {}, nFlatnessFeatures);
+        classifier.fit(X, y, w);
+
+        EXPECT_GT(GetIrisScore(classifier), nFlatnessFeatures == 1 ? -10.0 : -30.0);
+    }
+
+}
+
+// Older versions of gtest only provide the macro with the old name
+#ifndef INSTANTIATE_TEST_SUITE_P
+#define INSTANTIATE_TEST_SUITE_P INSTANTIATE_TEST_CASE_P
+#endif
+
+/**
+ * Creates a classifier with the options of one training configuration
+ */
+struct ClassifierConfiguration {
+    std::string name;
+    std::function<FastBDT::Classifier()> create;
+};
+
+void PrintTo(const ClassifierConfiguration &configuration, std::ostream *os) {
+    *os << configuration.name;
+}
+
+class ClassifierThreadsTest : public ClassifierTest, public ::testing::WithParamInterface<ClassifierConfiguration> { };
+
+TEST_P(ClassifierThreadsTest, ResultDoesNotDependOnNumberOfThreads) {
+
+    FastBDT::Classifier classifier1 = GetParam().create();
+    classifier1.fit(X, y, w);
+
+    FastBDT::Classifier classifier2 = GetParam().create();
+    classifier2.SetNThreads(4);
+    classifier2.fit(X, y, w);
+
+    EXPECT_EQ(classifier2.GetNThreads(), 4u);
+    EXPECT_EQ(GetIrisScore(classifier1), GetIrisScore(classifier2));
+    EXPECT_EQ(classifier1.GetOutOfBagLoss(), classifier2.GetOutOfBagLoss());
+
+}
+
+// The subsampling configurations use a fixed seed, otherwise every training draws a different subsample
+INSTANTIATE_TEST_SUITE_P(Configurations, ClassifierThreadsTest, ::testing::Values(
+    ClassifierConfiguration{"Default", []() {
+        return FastBDT::Classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+    }},
+    ClassifierConfiguration{"Subsample", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.5);
+        classifier.SetSeed(42);
+        return classifier;
+    }},
+    ClassifierConfiguration{"SPlotSubsample", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.5, true);
+        classifier.SetSeed(42);
+        return classifier;
+    }},
+    ClassifierConfiguration{"StratifiedSubsample", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.5);
+        classifier.SetSeed(42);
+        classifier.SetStratifiedSubsample(true);
+        return classifier;
+    }},
+    ClassifierConfiguration{"StratifiedSPlotSubsample", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.5, true);
+        classifier.SetSeed(42);
+        classifier.SetStratifiedSubsample(true);
+        return classifier;
+    }},
+    ClassifierConfiguration{"GOSS", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.3);
+        classifier.SetSeed(42);
+        classifier.SetGOSSTopFraction(0.2);
+        return classifier;
+    }},
+    ClassifierConfiguration{"StratifiedGOSS", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 0.3);
+        classifier.SetSeed(42);
+        classifier.SetGOSSTopFraction(0.2);
+        classifier.SetStratifiedSubsample(true);
+        return classifier;
+    }},
+    ClassifierConfiguration{"ColumnMajor", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+        classifier.SetColumnMajor(true);
+        return classifier;
+    }},
+    ClassifierConfiguration{"HistogramTileSize", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+        classifier.SetHistogramTileSize(1);
+        return classifier;
+    }},
+    ClassifierConfiguration{"AggregateDuplicates", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+        classifier.SetAggregateDuplicates(true);
+        return classifier;
+    }},
+    ClassifierConfiguration{"PurityTransformation", []() {
+        FastBDT::Classifier classifier(10, 3, {3, 5, 4, 2}, 0.1, 1.0);
+        classifier.SetPurityTransformation({true, true, false, true});
+        return classifier;
+    }},
+    ClassifierConfiguration{"BinningStrategy", []() {
+        FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0);
+        classifier.SetBinningStrategy({FastBDT::BinningStrategy::Equidistant, FastBDT::BinningStrategy::Weighted,
+                                       FastBDT::BinningStrategy::Quantile, FastBDT::BinningStrategy::Equidistant});
+        return classifier;
+    }},
+    ClassifierConfiguration{"BestFirstGrowth", []() {
+        FastBDT::Classifier classifier(10, 6, {4, 4, 4, 4}, 0.1, 1.0);
+        classifier.SetMaxLeaves(6);
+        return classifier;
+    }},
+    ClassifierConfiguration{"DeepTrees", []() {
+        return FastBDT::Classifier(10, 14, {4, 4, 4, 4}, 0.1, 1.0);
+    }},
+    ClassifierConfiguration{"OneFlatnessFeature", []() {
+        return FastBDT::Classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0, false, 1.0, {}, 1);
+    }},
+    ClassifierConfiguration{"TwoFlatnessFeatures", []() {
+        return FastBDT::Classifier(10, 3, {4, 4, 4, 4}, 0.1, 1.0, false, 1.0, {}, 2);
+    }}
+));
+
 TEST_F(ClassifierTest, LoadAndSaveWorks) {
 
     FastBDT::Classifier classifier(10, 3, {4, 4, 4, 4});
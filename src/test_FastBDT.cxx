@@ -8,6 +8,7 @@
 
 #include <sstream>
 #include <limits>
+#include <random>
 
 using namespace FastBDT;
 
@@ -268,6 +269,217 @@ TEST_F(FeatureBinningTest, LowStatisticIsHandledCorrectly) {
     
 }
 
+TEST_F(FeatureBinningTest, SelectionGivesSameBinningAsSorting) {
+
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution(0.0f, 1.0f);
+
+    for(unsigned int size : {1u, 2u, 3u, 17u, 100u, 1001u, 10000u}) {
+      std::vector<float> data(size);
+      for(auto &value : data)
+        value = (size % 2 == 0) ? std::round(distribution(generator) * 10.0f) : distribution(generator);
+      if(size > 2)
+        data[1] = NAN;
+
+      // Reference binning based on the fully sorted data
+      std::vector<float> sorted = data;
+      std::sort(sorted.begin(), sorted.end(), compareIncludingNaN<float>);
+      auto first = std::find_if(sorted.begin(), sorted.end(), [](float value) { return not std::isnan(value); });
+      std::vector<float> unique(first, sorted.end());
+      unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+      for(unsigned int nLevels : {2u, 3u, 5u, 8u}) {
+        const uint64_t nBins = (1ul << nLevels) + 1;
+        std::vector<float> values(first, sorted.end());
+        if(unique.size() <= nBins - 2) {
+          values.assign(nBins, unique.back());
+          values[0] = unique[0];
+          for(uint64_t i = 0; i < unique.size(); ++i)
+            values[i+1] = unique[i];
+        }
+        const uint64_t n = values.size();
+        std::vector<float> expected(nBins, values[0]);
+        expected[nBins-1] = values[n-1];
+        uint64_t index = 0;
+        for(uint64_t iLevel = 0; iLevel < nLevels; ++iLevel)
+          for(uint64_t iBin = 0; iBin < (1ul << iLevel); ++iBin)
+            expected[++index] = values[ (n >> (iLevel+1)) + ((iBin*n) >> iLevel) ];
+
+        std::vector<float> copy = data;
+        FeatureBinning<float> featureBinning(nLevels, copy);
+        EXPECT_EQ(featureBinning.GetBinning(), expected);
+      }
+    }
+
+}
+
+TEST_F(FeatureBinningTest, SketchWithoutCompactionGivesSameBinning) {
+
+    std::vector<float> data = {10.0f,8.0f,2.0f,NAN,NAN,NAN,NAN,7.0f,5.0f,6.0f,9.0f,NAN,4.0f,3.0f,11.0f,12.0f,1.0f,NAN};
+    std::vector<float> few = { 1.0f, 1.0f, 7.0, 6.0, 1.0f, 3.0f, 3.0f, 5.0f, 2.0f, 2.0f, 2.0f, 4.0f, 1.0f, 1.0f };
+    for(auto &values : {data, few}) {
+      QuantileSketch<float> sketch;
+      sketch.Add(values);
+      EXPECT_EQ(sketch.GetMaximumRankError(), 0u);
+      for(unsigned int nLevels : {2u, 3u, 4u}) {
+        std::vector<float> copy = values;
+        FeatureBinning<float> featureBinning(nLevels, copy);
+        SketchFeatureBinning<float> sketchBinning(nLevels, sketch);
+        EXPECT_EQ(sketchBinning.GetBinning(), featureBinning.GetBinning());
+      }
+    }
+
+    QuantileSketch<float> empty;
+    empty.Add(std::vector<float>{NAN, NAN});
+    EXPECT_EQ(empty.GetN(), 0u);
+    SketchFeatureBinning<float> emptyBinning(2, empty);
+    EXPECT_EQ(emptyBinning.GetBinning(), std::vector<float>(5, 0.0f));
+
+    EXPECT_THROW(QuantileSketch<float>(1), std::runtime_error);
+
+}
+
+TEST_F(FeatureBinningTest, MergedSketchesHaveBoundedRankError) {
+
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution(0.0f, 1.0f);
+    std::vector<float> data(100000);
+    for(auto &value : data)
+      value = distribution(generator);
+
+    // Fill four sketches in chunks and merge them, as it would be done by four threads
+    std::vector<QuantileSketch<float>> sketches(4, QuantileSketch<float>(128));
+    for(unsigned int iChunk = 0; iChunk < 100; ++iChunk)
+      sketches[iChunk % 4].Add(data.data() + iChunk*1000, 1000);
+    for(unsigned int iSketch = 1; iSketch < 4; ++iSketch)
+      sketches[0].Merge(sketches[iSketch]);
+    const QuantileSketch<float> &sketch = sketches[0];
+
+    std::vector<float> sorted = data;
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(sketch.GetN(), data.size());
+    EXPECT_EQ(sketch.GetMin(), sorted.front());
+    EXPECT_EQ(sketch.GetMax(), sorted.back());
+    EXPECT_GT(sketch.GetMaximumRankError(), 0u);
+    EXPECT_LT(sketch.GetMaximumRankError(), data.size() / 10);
+
+    uint64_t totalWeight = 0;
+    for(auto &item : sketch.GetSortedValues())
+      totalWeight += item.second;
+    EXPECT_EQ(totalWeight, data.size());
+
+    const unsigned int nLevels = 4;
+    SketchFeatureBinning<float> featureBinning(nLevels, sketch);
+    auto binning = featureBinning.GetBinning();
+    EXPECT_EQ(binning.front(), sorted.front());
+    EXPECT_EQ(binning.back(), sorted.back());
+
+    const int64_t size = sorted.size();
+    const int64_t error = sketch.GetMaximumRankError();
+    unsigned int index = 0;
+    for(unsigned int iLevel = 0; iLevel < nLevels; ++iLevel) {
+      for(unsigned int iBin = 0; iBin < (1u << iLevel); ++iBin) {
+        const int64_t rank = (size >> (iLevel+1)) + ((iBin*size) >> iLevel);
+        const float boundary = binning[++index];
+        // The boundary occupies the ranks [lower, upper) in the sorted data
+        const int64_t lower = std::lower_bound(sorted.begin(), sorted.end(), boundary) - sorted.begin();
+        const int64_t upper = std::upper_bound(sorted.begin(), sorted.end(), boundary) - sorted.begin();
+        EXPECT_GE(rank, lower - error);
+        EXPECT_LT(rank, upper + error);
+      }
+    }
+
+}
+
+TEST_F(FeatureBinningTest, SketchOfLongStreamKeepsFewValues) {
+
+    // The values 0, ..., N-1 are added in a scrambled order, so the exact rank of every value is the value itself
+    const uint64_t size = 1 << 20;
+    const unsigned int capacity = 256;
+    QuantileSketch<float> sketch(capacity);
+    for(uint64_t i = 0; i < size; ++i)
+      sketch.Add(static_cast<float>((i * 7919) % size));
+    EXPECT_EQ(sketch.GetN(), size);
+
+    // The memory is bounded by the capacity times the number of levels, instead of growing with the stream
+    const auto sorted = sketch.GetSortedValues();
+    EXPECT_LE(sorted.size(), capacity * 13u);
+    EXPECT_LT(sketch.GetMaximumRankError(), size / 10);
+
+    // The rank of every kept value in the sketch is within the maximum rank error of its exact rank
+    const int64_t error = sketch.GetMaximumRankError();
+    int64_t rank = 0;
+    for(auto &item : sorted) {
+      EXPECT_LE(std::abs(rank - static_cast<int64_t>(item.first)), error);
+      rank += item.second;
+    }
+    EXPECT_EQ(rank, static_cast<int64_t>(size));
+
+}
+
+TEST_F(FeatureBinningTest, EquidistantBinsHaveEqualWidth) {
+
+    // The values range from 0 to 8, so with 3 levels the boundaries are 0, 1, ..., 8
+    std::vector<float> data = {3.5f, 8.0f, 1.2f, NAN, 0.0f, 6.1f};
+    EquidistantFeatureBinning<float> binning(3, data);
+    std::vector<float> boundaries = binning.GetBinning();
+    std::sort(boundaries.begin(), boundaries.end());
+    EXPECT_EQ(boundaries, std::vector<float>({0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f}));
+
+    // The first bin contains the underflow and the last bin the overflow, bin 0 is reserved for NaN
+    for(float value = -1.0f; value <= 9.0f; value += 0.25f) {
+      const unsigned int expected = static_cast<unsigned int>(std::min(7.0f, std::max(0.0f, std::floor(value)))) + 1;
+      EXPECT_EQ(binning.ValueToBin(value), expected) << "value = " << value;
+    }
+    EXPECT_EQ(binning.ValueToBin(NAN), 0u);
+    for(unsigned int iBin = 2; iBin <= 8; ++iBin)
+      EXPECT_EQ(binning.BinToValue(iBin), static_cast<float>(iBin - 1));
+
+}
+
+TEST_F(FeatureBinningTest, EquidistantLookupGivesSameBinsAsTreeSearch) {
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-3.0f, 7.0f);
+    std::vector<float> data(1000);
+    for(auto &value : data)
+      value = distribution(generator);
+
+    for(unsigned int nLevels : {2u, 3u, 6u}) {
+      std::vector<float> copy = data;
+      EquidistantFeatureBinning<float> equidistantBinning(nLevels, copy);
+      EXPECT_TRUE(equidistantBinning.IsEquidistant());
+      FeatureBinning<float> treeBinning = equidistantBinning;
+      treeBinning.SetEquidistant(false);
+      EXPECT_FALSE(treeBinning.IsEquidistant());
+
+      // Random values, the boundaries themselves and their neighbouring floats, and the special values
+      std::vector<float> values(data.begin(), data.end());
+      for(auto &boundary : equidistantBinning.GetBinning()) {
+        values.push_back(boundary);
+        values.push_back(std::nextafter(boundary, -std::numeric_limits<float>::infinity()));
+        values.push_back(std::nextafter(boundary, std::numeric_limits<float>::infinity()));
+      }
+      values.insert(values.end(), {NAN, -100.0f, 100.0f, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()});
+      for(auto &value : values)
+        EXPECT_EQ(equidistantBinning.ValueToBin(value), treeBinning.ValueToBin(value));
+    }
+
+    // Also for a quantile binning the result of the lookup is the same
+    std::vector<float> copy = data;
+    FeatureBinning<float> quantileBinning(4, copy);
+    FeatureBinning<float> lookupBinning = quantileBinning;
+    lookupBinning.SetEquidistant(true);
+    for(auto &value : data)
+      EXPECT_EQ(lookupBinning.ValueToBin(value), quantileBinning.ValueToBin(value));
+
+    std::vector<float> constant = {2.0f, 2.0f, 2.0f};
+    EquidistantFeatureBinning<float> constantBinning(3, constant);
+    EXPECT_EQ(constantBinning.ValueToBin(1.0f), 1u);
+    EXPECT_EQ(constantBinning.ValueToBin(2.0f), 8u);
+
+}
+
 class WeightedFeatureBinningTest : public ::testing::Test {
     protected:
         virtual void SetUp() {
@@ -392,6 +604,56 @@ TEST_F(EquidistantFeatureBinningTest, GetBinningIsCorrect) {
 }
 
 
+TEST(SortAlmostSortedTest, EventsAreOrderedByValueAndIndex) {
+
+    // Values slightly shifted from a sorted order, like F after one more tree, with ties and NaN values
+    std::vector<ValueWithIndex<double>> events;
+    for(unsigned int iEvent = 0; iEvent < 1000; ++iEvent) {
+        double value = iEvent / 10 + 0.3 * ((iEvent * 7) % 5);
+        if(iEvent % 97 == 0)
+            value = std::numeric_limits<double>::quiet_NaN();
+        events.push_back({value, (iEvent * 13) % 1000});
+    }
+    std::vector<ValueWithIndex<double>> buffer(events.size());
+
+    for(unsigned int nEvents : {0u, 1u, 2u, 17u, 1000u}) {
+        std::vector<ValueWithIndex<double>> sorted(events.begin(), events.begin() + nEvents);
+        SortAlmostSorted(sorted.data(), sorted.data() + nEvents, buffer.data());
+
+        // NaN values first, then increasing values, and events with the same value by increasing index
+        std::vector<ValueWithIndex<double>> expected(events.begin(), events.begin() + nEvents);
+        std::sort(expected.begin(), expected.end(), [](const ValueWithIndex<double> &i, const ValueWithIndex<double> &j) {
+            if(std::isnan(i.value) != std::isnan(j.value))
+                return std::isnan(i.value);
+            if(not std::isnan(i.value) and i.value != j.value)
+                return i.value < j.value;
+            return i.index < j.index;
+        });
+        ASSERT_EQ( sorted.size(), expected.size() );
+        for(unsigned int iEvent = 0; iEvent < nEvents; ++iEvent) {
+            EXPECT_EQ( sorted[iEvent].index, expected[iEvent].index );
+            if(std::isnan(expected[iEvent].value)) {
+                EXPECT_TRUE( std::isnan(sorted[iEvent].value) );
+            } else {
+                EXPECT_EQ( sorted[iEvent].value, expected[iEvent].value );
+            }
+        }
+    }
+
+    // An already sorted input stays unchanged, and a reversed input is sorted as well
+    std::vector<ValueWithIndex<double>> sorted(events.begin() + 1, events.begin() + 97);
+    SortAlmostSorted(sorted.data(), sorted.data() + sorted.size(), buffer.data());
+    std::vector<ValueWithIndex<double>> resorted = sorted;
+    SortAlmostSorted(resorted.data(), resorted.data() + resorted.size(), buffer.data());
+    std::vector<ValueWithIndex<double>> reversed(sorted.rbegin(), sorted.rend());
+    SortAlmostSorted(reversed.data(), reversed.data() + reversed.size(), buffer.data());
+    for(unsigned int iEvent = 0; iEvent < sorted.size(); ++iEvent) {
+        EXPECT_EQ( resorted[iEvent].index, sorted[iEvent].index );
+        EXPECT_EQ( reversed[iEvent].index, sorted[iEvent].index );
+    }
+
+}
+
 class PurityTransformationTest : public ::testing::Test {
     protected:
         virtual void SetUp() {
@@ -509,6 +771,36 @@ TEST_F(EventWeightsTest, WeightSumsAndGetterAreCorrectlyUpdated) {
 
 }
 
+TEST_F(EventWeightsTest, EffectiveWeightsFollowBothSetters) {
+
+    for(unsigned int i = 0; i < 10; ++i) {
+        eventWeights->SetOriginal(i, static_cast<Weight>(i % 3));
+    }
+
+    const Weight *effective = eventWeights->GetEffective();
+    for(unsigned int i = 0; i < 10; ++i) {
+        EXPECT_EQ( effective[i], static_cast<Weight>((i+1) * (i % 3)));
+        EXPECT_EQ( &eventWeights->Get(i), effective + i);
+    }
+
+    // A new boosting weight updates the effective weight in place, the original weight is kept
+    for(unsigned int i = 0; i < 10; ++i) {
+        eventWeights->Set(i, 0.5f);
+    }
+    EXPECT_EQ( eventWeights->GetEffective(), effective );
+    for(unsigned int i = 0; i < 10; ++i) {
+        EXPECT_EQ( effective[i], 0.5f * static_cast<Weight>(i % 3));
+        EXPECT_EQ( eventWeights->GetWithoutOriginal(i), 0.5f);
+        EXPECT_EQ( eventWeights->GetOriginal(i), static_cast<Weight>(i % 3));
+    }
+
+    // The sums are calculated from the effective weights
+    auto sums = eventWeights->GetSums(5);
+    EXPECT_FLOAT_EQ(sums[0], 0.5 * (0 + 1 + 2 + 0 + 1));
+    EXPECT_FLOAT_EQ(sums[1], 0.5 * (2 + 0 + 1 + 2 + 0));
+
+}
+
 class EventFlagsTest : public ::testing::Test {
 
     protected:
@@ -565,17 +857,90 @@ TEST_F(EventValuesTest, SetterAndGetterWorkCorrectly) {
     
     for(unsigned int i = 0; i < 8; ++i) {
         std::vector<unsigned int> features = { i, static_cast<unsigned int>(4 + (1-2*((int)(i)%2))*((int)(i)+1)/2), static_cast<unsigned int>((int)(i) % 4 + 1),  7-i, i };
-        const auto *array = &eventValues->Get(i);
+        const auto event = eventValues->GetEvent(i);
         for(unsigned int j = 0; j < 3; ++j) {
             EXPECT_EQ( eventValues->Get(i,j), features[j]);
-            EXPECT_EQ( array[j], features[j]);
+            EXPECT_EQ( event[j], features[j]);
         }
         EXPECT_EQ( eventValues->GetSpectator(i,0), features[4]);
-        EXPECT_EQ( array[4], features[4]);
+        EXPECT_EQ( event[4], features[4]);
+    }
+}
+
+TEST_F(EventValuesTest, CompactStorageWorksCorrectly) {
+
+    EventValues compactValues(9, 3, 1, {3, 8, 2, 12}, true);
+    const auto &bitWidths = compactValues.GetBitWidths();
+    EXPECT_EQ( bitWidths[0], 4u);
+    EXPECT_EQ( bitWidths[1], 16u);
+    EXPECT_EQ( bitWidths[2], 4u);
+    EXPECT_EQ( bitWidths[3], 16u);
+    EXPECT_EQ( compactValues.GetMemorySize(), 9u*5u);
+
+    EventValues wideValues(9, 3, 1, {3, 8, 2, 12});
+    EXPECT_EQ( wideValues.GetMemorySize(), 9u*16u);
+
+    // Set the events in reverse order to check that neighbouring values are not overwritten
+    for(unsigned int i = 9; i > 0; --i) {
+        compactValues.Set(i-1, {i, 257-i, i%6, 4000+i});
+    }
+    for(unsigned int i = 1; i <= 9; ++i) {
+        EXPECT_EQ( compactValues.Get(i-1, 0), i);
+        EXPECT_EQ( compactValues.Get(i-1, 1), 257-i);
+        EXPECT_EQ( compactValues.Get(i-1, 2), i%6);
+        EXPECT_EQ( compactValues.GetSpectator(i-1, 0), 4000+i);
+    }
+
+    EventValues columnValues(9, 3, 1, {3, 8, 2, 12}, true, true);
+    EXPECT_TRUE( columnValues.IsColumnMajor() );
+    for(unsigned int i = 1; i <= 9; ++i) {
+        columnValues.Set(i-1, {i, 257-i, i%6, 4000+i});
+    }
+    std::vector<unsigned int> eventIndices = {8, 0, 3, 4};
+    std::vector<unsigned int> featureValues(4);
+    for(unsigned int iFeature = 0; iFeature < 4; ++iFeature) {
+        columnValues.GetFeatureValues(iFeature, eventIndices.data(), eventIndices.data() + 4, featureValues.data());
+        for(unsigned int i = 0; i < 4; ++i) {
+            EXPECT_EQ( featureValues[i], compactValues.Get(eventIndices[i], iFeature));
+            EXPECT_EQ( columnValues.Get(eventIndices[i], iFeature), compactValues.Get(eventIndices[i], iFeature));
+        }
     }
+
+    EventValues byteValues(2, 1, 0, {7}, true);
+    EXPECT_EQ( byteValues.GetBitWidths()[0], 8u);
+    byteValues.Set(1, {129});
+    EXPECT_EQ( byteValues.Get(1), 129u);
+    EXPECT_EQ( byteValues.Get(0), 0u);
+
 }
 
 
+TEST_F(EventValuesTest, ColumnMajorLayoutStoresFeaturesConsecutively) {
+
+    // In the row-major layout the values of one event form a record of 40 bits,
+    // in the column-major layout the values of one feature follow each other and every column is padded to 8 bytes
+    EventValues rowValues(9, 3, 1, {3, 8, 2, 12}, true);
+    EventValues columnValues(9, 3, 1, {3, 8, 2, 12}, true, true);
+    EXPECT_FALSE( rowValues.IsColumnMajor() );
+    EXPECT_TRUE( columnValues.IsColumnMajor() );
+    EXPECT_EQ( rowValues.GetBitStrides(), std::vector<uint64_t>({40, 40, 40, 40}));
+    EXPECT_EQ( columnValues.GetBitStrides(), std::vector<uint64_t>({4, 16, 4, 16}));
+    EXPECT_EQ( rowValues.GetMemorySize(), 9u*5u);
+    EXPECT_EQ( columnValues.GetMemorySize(), 8u + 24u + 8u + 24u);
+
+    // The 4 bit values of two consecutive events share a byte
+    for(unsigned int i = 0; i < 9; ++i) {
+        columnValues.Set(i, {i + 1, 256 - i, 4 - i % 5, 4096 - i});
+    }
+    for(unsigned int i = 0; i < 9; ++i) {
+        EXPECT_EQ( columnValues.Get(i, 0), i + 1);
+        EXPECT_EQ( columnValues.Get(i, 1), 256 - i);
+        EXPECT_EQ( columnValues.Get(i, 2), 4 - i % 5);
+        EXPECT_EQ( columnValues.GetSpectator(i, 0), 4096 - i);
+    }
+
+}
+
 TEST_F(EventValuesTest, ThrowOnMismatchBetweenNFeaturesAndNBinsSize) {
     
   EXPECT_THROW( EventValues(8, 3, 0, {1, 2}), std::runtime_error );
@@ -687,6 +1052,68 @@ TEST_F(EventSampleTest, AddingEventsWithNANWeightsThrow) {
 
 }
 
+TEST_F(EventSampleTest, CompactSampleStoresEveryFeatureWithSmallestWidth) {
+
+    // The features need 4, 8, 4 and 16 bits, so an event takes 4 bytes instead of 16 bytes
+    const unsigned int numberOfEvents = 1000;
+    EventSample compactSample(numberOfEvents, 3, 1, {2, 7, 3, 12}, true);
+    EventSample wideSample(numberOfEvents, 3, 1, {2, 7, 3, 12});
+    EXPECT_EQ( compactSample.GetValues().GetBitWidths(), std::vector<unsigned char>({4, 8, 4, 16}));
+    EXPECT_EQ( compactSample.GetValues().GetMemorySize(), numberOfEvents * 4u);
+    EXPECT_EQ( wideSample.GetValues().GetMemorySize(), numberOfEvents * 16u);
+
+    // The largest bin of every feature fits into its width
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        std::vector<unsigned int> features = {i % 5, 128 - i % 129, i % 9, 4096 - i};
+        compactSample.AddEvent(features, 1.0, true);
+        wideSample.AddEvent(features, 1.0, true);
+    }
+    for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+        for(unsigned int iFeature = 0; iFeature < 4; ++iFeature)
+            EXPECT_EQ( compactSample.GetValues().Get(iEvent, iFeature), wideSample.GetValues().Get(iEvent, iFeature));
+    }
+    EXPECT_EQ( compactSample.GetValues().Get(4, 0), 4u);
+    EXPECT_EQ( compactSample.GetValues().Get(0, 1), 128u);
+    EXPECT_EQ( compactSample.GetValues().Get(8, 2), 8u);
+    EXPECT_EQ( compactSample.GetValues().Get(0, 3), 4096u);
+
+}
+
+TEST_F(EventSampleTest, AddingEventsIntoReservedSlotsWorksCorrectly) {
+
+    for(bool columnMajor : {false, true}) {
+        EventSample sequentialSample(10, 3, 1, {8, 8, 2, 2}, true, columnMajor);
+        EventSample slotSample(10, 3, 1, {8, 8, 2, 2}, true, columnMajor);
+        slotSample.ReserveSlots(5);
+        EXPECT_THROW(slotSample.ReserveSlots(5), std::runtime_error);
+        EXPECT_EQ( slotSample.GetNSignals(), 5u);
+        EXPECT_EQ( slotSample.GetNBckgrds(), 5u);
+
+        for(unsigned int i = 0; i < 10; ++i) { 
+            sequentialSample.AddEvent( std::vector<unsigned int>({2*i,3*i,i%5,1}), 1.0f + i, i % 2 == 0 );
+        }
+        // Fill the slots in reversed order, the events end up at the same positions nevertheless
+        for(unsigned int i = 10; i > 0; --i) { 
+            slotSample.AddEvent( (i-1) / 2, std::vector<unsigned int>({2*(i-1),3*(i-1),(i-1)%5,1}), static_cast<float>(i), (i-1) % 2 == 0 );
+        }
+
+        for(unsigned int iEvent = 0; iEvent < 10; ++iEvent) {
+            EXPECT_EQ( slotSample.GetWeights().GetOriginal(iEvent), sequentialSample.GetWeights().GetOriginal(iEvent));
+            for(unsigned int iFeature = 0; iFeature < 4; ++iFeature)
+                EXPECT_EQ( slotSample.GetValues().Get(iEvent, iFeature), sequentialSample.GetValues().Get(iEvent, iFeature));
+        }
+        EXPECT_EQ( slotSample.GetSlotPosition(1, false), 8u);
+
+        EXPECT_THROW( slotSample.AddEvent( 5, std::vector<unsigned int>({1,2,3,1}), 2.0, true ), std::runtime_error);
+        EXPECT_THROW( slotSample.AddEvent( 0, std::vector<unsigned int>({1,2,3,1}), NAN, true ), std::runtime_error);
+        EXPECT_THROW( slotSample.AddEvent( std::vector<unsigned int>({1,2,3,1}), 2.0, true ), std::runtime_error);
+    }
+
+    EventSample tooSmall(10, 3, 1, {8, 8, 8, 4});
+    EXPECT_THROW(tooSmall.ReserveSlots(11), std::runtime_error);
+
+}
+
 class CumulativeDistributionsTest : public ::testing::Test {
     protected:
         virtual void SetUp() {
@@ -958,6 +1385,282 @@ TEST_F(CumulativeDistributionsTest, DifferentBinningLevels) {
     delete sample;
 }
 
+TEST_F(CumulativeDistributionsTest, ResultDoesNotDependOnNumberOfThreads) {
+
+    // Use enough events, so that the sample is split into several chunks
+    const unsigned int numberOfEvents = 300000;
+    EventSample *sample = new EventSample(numberOfEvents, 2, 0, {3, 4});
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        sample->AddEvent(std::vector<unsigned int>({i % 9, (i * 7) % 17}), 1.0f + 0.1f * (i % 13), i % 3 == 0);
+    }
+    auto &eventFlags = sample->GetFlags();
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        eventFlags.Set(i, i % 5 == 0 ? 0 : i%2 + 2);
+    }
+
+    CumulativeDistributions CDFs(1, *sample, 1);
+    for(unsigned int nThreads : {2u, 3u, 8u}) {
+      CumulativeDistributions parallelCDFs(1, *sample, nThreads);
+      for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+        for(unsigned int iBin = 0; iBin < 9; ++iBin) {
+          EXPECT_EQ( CDFs.GetSignal(iNode, 0, iBin), parallelCDFs.GetSignal(iNode, 0, iBin));
+          EXPECT_EQ( CDFs.GetBckgrd(iNode, 0, iBin), parallelCDFs.GetBckgrd(iNode, 0, iBin));
+        }
+        for(unsigned int iBin = 0; iBin < 17; ++iBin) {
+          EXPECT_EQ( CDFs.GetSignal(iNode, 1, iBin), parallelCDFs.GetSignal(iNode, 1, iBin));
+          EXPECT_EQ( CDFs.GetBckgrd(iNode, 1, iBin), parallelCDFs.GetBckgrd(iNode, 1, iBin));
+        }
+      }
+    }
+    
+    delete sample;
+}
+
+TEST_F(CumulativeDistributionsTest, ColumnMajorLayoutGivesSameResult) {
+
+    const unsigned int numberOfEvents = 1000;
+    EventSample rowSample(numberOfEvents, 3, 0, {2, 5, 9});
+    EventSample columnSample(numberOfEvents, 3, 0, {2, 5, 9}, true, true);
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        std::vector<unsigned int> features = {i % 5, (i * 7) % 33, (i * 13) % 513};
+        rowSample.AddEvent(features, 1.0f + 0.1f * (i % 13), i % 3 == 0);
+        columnSample.AddEvent(features, 1.0f + 0.1f * (i % 13), i % 3 == 0);
+    }
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        rowSample.GetFlags().Set(i, i % 5 == 0 ? 0 : i%2 + 2);
+        columnSample.GetFlags().Set(i, i % 5 == 0 ? 0 : i%2 + 2);
+    }
+
+    CumulativeDistributions rowCDFs(1, rowSample);
+    CumulativeDistributions columnCDFs(1, columnSample);
+    const auto &nBins = rowCDFs.GetNBins();
+    for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+      for(unsigned int iFeature = 0; iFeature < 3; ++iFeature) {
+        for(unsigned int iBin = 0; iBin < nBins[iFeature]; ++iBin) {
+          EXPECT_EQ( rowCDFs.GetSignal(iNode, iFeature, iBin), columnCDFs.GetSignal(iNode, iFeature, iBin));
+          EXPECT_EQ( rowCDFs.GetBckgrd(iNode, iFeature, iBin), columnCDFs.GetBckgrd(iNode, iFeature, iBin));
+        }
+      }
+    }
+
+}
+
+TEST_F(CumulativeDistributionsTest, FeatureTilingGivesSameResult) {
+
+    const unsigned int numberOfEvents = 5000;
+    EventSample sample(numberOfEvents, 3, 0, {2, 5, 9});
+    EventSample tiledSample(numberOfEvents, 3, 0, {2, 5, 9});
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        std::vector<unsigned int> features = {i % 5, (i * 7) % 33, (i * 13) % 513};
+        sample.AddEvent(features, 1.0f + 0.1f * (i % 13), i % 3 == 0);
+        tiledSample.AddEvent(features, 1.0f + 0.1f * (i % 13), i % 3 == 0);
+    }
+
+    // A tile of 320 bytes holds the 38 bins of the first two features
+    EXPECT_EQ(sample.GetHistogramTileSize(), 0u);
+    EXPECT_EQ(sample.GetFeatureTiles(), std::vector<unsigned int>({0, 3}));
+    tiledSample.SetHistogramTileSize(320);
+    EXPECT_EQ(tiledSample.GetHistogramTileSize(), 320u);
+    EXPECT_EQ(tiledSample.GetFeatureTiles(), std::vector<unsigned int>({0, 2, 3}));
+    tiledSample.SetHistogramTileSize(1);
+    EXPECT_EQ(tiledSample.GetFeatureTiles(), std::vector<unsigned int>({0, 1, 2, 3}));
+
+    CumulativeDistributions CDFs(0, sample);
+    CumulativeDistributions tiledCDFs(0, tiledSample);
+    const auto &nBins = CDFs.GetNBins();
+    for(unsigned int iFeature = 0; iFeature < 3; ++iFeature) {
+      for(unsigned int iBin = 0; iBin < nBins[iFeature]; ++iBin) {
+        EXPECT_EQ( CDFs.GetSignal(0, iFeature, iBin), tiledCDFs.GetSignal(0, iFeature, iBin));
+        EXPECT_EQ( CDFs.GetBckgrd(0, iFeature, iBin), tiledCDFs.GetBckgrd(0, iFeature, iBin));
+      }
+    }
+
+}
+
+TEST_F(CumulativeDistributionsTest, OnlyIndexedEventsAreUsed) {
+
+    // The first node contains every third event and the second node the events 50, ..., 59,
+    // the events between the two ranges belong to no node. The flags are not read, so all events are disabled.
+    std::vector<unsigned int> eventIndices;
+    for(unsigned int i = 0; i < 100; i += 3)
+        eventIndices.push_back(i);
+    const unsigned int nFirst = eventIndices.size();
+    for(unsigned int i = 1; i < 100; i += 17)
+        eventIndices.push_back(i);
+    const unsigned int nUnused = eventIndices.size();
+    for(unsigned int i = 50; i < 60; ++i)
+        eventIndices.push_back(i);
+    std::vector<EventRange> eventRanges = {{0, nFirst}, {nUnused, static_cast<unsigned int>(eventIndices.size())}};
+
+    auto &eventFlags = eventSample->GetFlags();
+    for(unsigned int i = 0; i < 100; ++i)
+        eventFlags.Set(i, 0);
+
+    CumulativeDistributions CDFs(1, *eventSample, eventIndices, eventRanges);
+    for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+      for(unsigned int iFeature = 0; iFeature < 2; ++iFeature) {
+        for(unsigned int iBin = 1; iBin < 5; ++iBin) {
+          Weight signal = 0;
+          Weight bckgrd = 0;
+          for(unsigned int i = eventRanges[iNode].first; i < eventRanges[iNode].last; ++i) {
+            const unsigned int iEvent = eventIndices[i];
+            if( eventSample->GetValues().Get(iEvent, iFeature) > iBin )
+              continue;
+            if( eventSample->IsSignal(iEvent) )
+              signal += eventSample->GetWeights().GetOriginal(iEvent);
+            else
+              bckgrd += eventSample->GetWeights().GetOriginal(iEvent);
+          }
+          EXPECT_FLOAT_EQ( CDFs.GetSignal(iNode, iFeature, iBin), signal);
+          EXPECT_FLOAT_EQ( CDFs.GetBckgrd(iNode, iFeature, iBin), bckgrd);
+        }
+      }
+    }
+
+    EXPECT_THROW( CumulativeDistributions(1, *eventSample, eventIndices, {eventRanges[0]}), std::runtime_error );
+
+}
+
+TEST_F(CumulativeDistributionsTest, FeatureTilesFitIntoTileSize) {
+
+    // Features with 5 to 4097 bins, so the histograms of all features take about 100 KB
+    std::vector<unsigned int> nLevels;
+    for(unsigned int iFeature = 0; iFeature < 30; ++iFeature)
+        nLevels.push_back(2 + (iFeature * 7) % 11);
+    EventSample sample(10, 30, 0, nLevels);
+    const auto &nBinSums = sample.GetValues().GetNBinSums();
+    EXPECT_GT( 2 * sizeof(Weight) * nBinSums.back(), 64u * 1024u );
+
+    // Every tile is filled with consecutive features until the next feature does not fit anymore,
+    // a feature whose histogram is larger than the tile size forms a tile on its own.
+    // The automatic tile size is 64 KB.
+    for(unsigned int tileSize : {0u, 64u * 1024u, 4096u, 1000u, 1u}) {
+        sample.SetHistogramTileSize(tileSize);
+        const unsigned int nBytes = (tileSize == 0) ? 64 * 1024 : tileSize;
+        const auto &featureTiles = sample.GetFeatureTiles();
+        ASSERT_GE( featureTiles.size(), 2u );
+        EXPECT_EQ( featureTiles.front(), 0u );
+        EXPECT_EQ( featureTiles.back(), 30u );
+        for(unsigned int iTile = 0; iTile + 1 < featureTiles.size(); ++iTile) {
+            const unsigned int first = featureTiles[iTile];
+            const unsigned int last = featureTiles[iTile + 1];
+            ASSERT_LT( first, last );
+            if( last - first > 1 ) {
+                EXPECT_LE( 2 * sizeof(Weight) * (nBinSums[last] - nBinSums[first]), nBytes );
+            }
+            if( last < 30 ) {
+                EXPECT_GT( 2 * sizeof(Weight) * (nBinSums[last + 1] - nBinSums[first]), nBytes );
+            }
+        }
+    }
+    EXPECT_EQ( sample.GetFeatureTiles().size(), 31u );
+
+}
+
+TEST_F(CumulativeDistributionsTest, SubtractionFromParentLayerIsCorrect) {
+
+    // Every eleventh event is disabled by the bagging
+    auto &eventFlags = eventSample->GetFlags();
+    for(unsigned int i = 0; i < 100; i += 11) {
+        eventFlags.Set(i, 0);
+    }
+    CumulativeDistributions CDFsForLayer0(0, *eventSample);
+
+    // Route the events into the two children of the root node, every seventh event
+    // is dropped at the root node as if it had a NaN value in the cut feature
+    for(unsigned int i = 0; i < 100; ++i) {
+        if(i % 11 == 0)
+            continue;
+        if(i % 7 == 0)
+            eventFlags.Set(i, -1);
+        else
+            eventFlags.Set(i, i%2 + 2 );
+    }
+    CumulativeDistributions CDFsForLayer1(1, *eventSample);
+
+    // The events of the left child are followed by the dropped events and the events of the right child
+    std::vector<unsigned int> eventIndices;
+    std::vector<unsigned int> boundaries;
+    for(int flag : {2, -1, 3}) {
+        for(unsigned int i = 0; i < 100; ++i) {
+            if(eventFlags.Get(i) == flag)
+                eventIndices.push_back(i);
+        }
+        boundaries.push_back(eventIndices.size());
+    }
+    std::vector<EventRange> eventRanges = {{0, boundaries[0]}, {boundaries[1], boundaries[2]}};
+
+    CumulativeDistributions indexedCDFsForLayer1(1, *eventSample, eventIndices, eventRanges);
+    for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+      for(unsigned int iBin = 0; iBin < 5; ++iBin) {
+        EXPECT_FLOAT_EQ( CDFsForLayer1.GetSignal(iNode, 0, iBin), indexedCDFsForLayer1.GetSignal(iNode, 0, iBin));
+        EXPECT_FLOAT_EQ( CDFsForLayer1.GetBckgrd(iNode, 0, iBin), indexedCDFsForLayer1.GetBckgrd(iNode, 0, iBin));
+      }
+    }
+
+    for(int filledChild : {0, 1}) {
+      CumulativeDistributions subtractedCDFsForLayer1(1, *eventSample, CDFsForLayer0, {filledChild}, eventIndices, eventRanges);
+      for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+        for(unsigned int iFeature = 0; iFeature < 2; ++iFeature) {
+          for(unsigned int iBin = 0; iBin < 5; ++iBin) {
+            EXPECT_FLOAT_EQ( CDFsForLayer1.GetSignal(iNode, iFeature, iBin), subtractedCDFsForLayer1.GetSignal(iNode, iFeature, iBin));
+            EXPECT_FLOAT_EQ( CDFsForLayer1.GetBckgrd(iNode, iFeature, iBin), subtractedCDFsForLayer1.GetBckgrd(iNode, iFeature, iBin));
+          }
+        }
+      }
+
+      // The events of the sibling are never read, its histogram is obtained from the parent alone,
+      // so the distributions are the same if the range of the sibling is empty
+      std::vector<EventRange> siblinglessRanges = eventRanges;
+      if( filledChild == 0 )
+        siblinglessRanges[1] = {boundaries[1], boundaries[1]};
+      else
+        siblinglessRanges[0] = {boundaries[0], boundaries[0]};
+      CumulativeDistributions siblinglessCDFsForLayer1(1, *eventSample, CDFsForLayer0, {filledChild}, eventIndices, siblinglessRanges);
+      for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+        for(unsigned int iFeature = 0; iFeature < 2; ++iFeature) {
+          for(unsigned int iBin = 0; iBin < 5; ++iBin) {
+            EXPECT_FLOAT_EQ( CDFsForLayer1.GetSignal(iNode, iFeature, iBin), siblinglessCDFsForLayer1.GetSignal(iNode, iFeature, iBin));
+            EXPECT_FLOAT_EQ( CDFsForLayer1.GetBckgrd(iNode, iFeature, iBin), siblinglessCDFsForLayer1.GetBckgrd(iNode, iFeature, iBin));
+          }
+        }
+      }
+    }
+
+    // If the parent node was not split, both children are empty
+    CumulativeDistributions emptyCDFsForLayer1(1, *eventSample, CDFsForLayer0, {-1}, eventIndices, eventRanges);
+    for(unsigned int iNode = 0; iNode < 2; ++iNode) {
+      for(unsigned int iBin = 0; iBin < 5; ++iBin) {
+        EXPECT_FLOAT_EQ( emptyCDFsForLayer1.GetSignal(iNode, 0, iBin), 0.0);
+        EXPECT_FLOAT_EQ( emptyCDFsForLayer1.GetBckgrd(iNode, 0, iBin), 0.0);
+      }
+    }
+
+    EXPECT_THROW(CumulativeDistributions(2, *eventSample, CDFsForLayer0, {0}, eventIndices, eventRanges), std::runtime_error);
+
+}
+
+class RunInParallelTest : public ::testing::Test { };
+
+TEST_F(RunInParallelTest, EveryThreadIsCalledOnce) {
+
+    std::vector<unsigned int> calls(5, 0);
+    RunInParallel(5, [&](unsigned int iThread) { calls[iThread]++; });
+    for(auto &c : calls)
+      EXPECT_EQ(c, 1u);
+
+    std::vector<unsigned int> single_call(1, 0);
+    RunInParallel(0, [&](unsigned int iThread) { single_call[iThread]++; });
+    EXPECT_EQ(single_call[0], 1u);
+
+}
+
+TEST_F(RunInParallelTest, ExceptionsAreRethrown) {
+
+    EXPECT_THROW(RunInParallel(3, [&](unsigned int iThread) { if(iThread == 2) throw std::runtime_error("Test"); }), std::runtime_error);
+
+}
+
 class LossFunctionTest : public ::testing::Test { };
 
 TEST_F(LossFunctionTest, GiniIndexIsCorrect) {
@@ -970,6 +1673,145 @@ TEST_F(LossFunctionTest, GiniIndexIsCorrect) {
 
 }
 
+class FindBestCutTest : public ::testing::Test { };
+
+TEST_F(FindBestCutTest, LastBestCutIsChosen) {
+
+    // Signal and background are interleaved
+    std::vector<Weight> CDF = {1.0, 3.0, 3.0, 1.0, 1.0, 3.0, 3.0, 1.0, 4.0, 4.0};
+    const Weight currentLoss = LossFunction(4.0, 4.0);
+
+    for(auto instructionSet : {InstructionSet::Scalar, InstructionSet::AVX2, InstructionSet::AVX512}) {
+      if(not IsSupported(instructionSet))
+        continue;
+
+      // The first four cuts have the same gain
+      Weight bestGain = 0;
+      EXPECT_EQ( FindBestCut(CDF.data(), 5, 4.0, 4.0, currentLoss, bestGain, instructionSet), 3);
+      EXPECT_FLOAT_EQ( bestGain, 0.5);
+
+      // No cut is better than the given gain
+      bestGain = 1.0;
+      EXPECT_EQ( FindBestCut(CDF.data(), 5, 4.0, 4.0, currentLoss, bestGain, instructionSet), -1);
+      EXPECT_FLOAT_EQ( bestGain, 1.0);
+    }
+
+}
+
+TEST_F(FindBestCutTest, CutWithLargestGainIsChosen) {
+
+    // Signal accumulates at low bins and background at high bins, so the gain has a single maximum inside the range of cuts.
+    // The numbers of cuts cover a scalar tail only, vectorized loops and vectorized loops followed by a tail.
+    for(unsigned int nCuts : {5u, 20u, 37u}) {
+      const Weight signal = 100.0;
+      const Weight bckgrd = 100.0;
+      std::vector<Weight> CDF(2*nCuts);
+      for(unsigned int iCut = 0; iCut < nCuts; ++iCut) {
+        const Weight x = static_cast<Weight>(iCut + 1) / (nCuts + 1);
+        CDF[2*iCut] = signal * std::sqrt(x);
+        CDF[2*iCut+1] = bckgrd * x * x;
+      }
+      const Weight currentLoss = LossFunction(signal, bckgrd);
+
+      int expectedCut = -1;
+      Weight expectedGain = 0;
+      for(unsigned int iCut = 0; iCut < nCuts; ++iCut) {
+        const Weight gain = currentLoss - LossFunction(signal - CDF[2*iCut], bckgrd - CDF[2*iCut+1]) - LossFunction(CDF[2*iCut], CDF[2*iCut+1]);
+        if( gain >= expectedGain ) {
+          expectedGain = gain;
+          expectedCut = iCut;
+        }
+      }
+      ASSERT_GT( expectedCut, 0 );
+      ASSERT_LT( expectedCut, static_cast<int>(nCuts) - 1 );
+
+      for(auto instructionSet : {InstructionSet::Scalar, InstructionSet::AVX2, InstructionSet::AVX512}) {
+        if(not IsSupported(instructionSet))
+          continue;
+        Weight bestGain = 0;
+        EXPECT_EQ( FindBestCut(CDF.data(), nCuts, signal, bckgrd, currentLoss, bestGain, instructionSet), expectedCut);
+        EXPECT_FLOAT_EQ( bestGain, expectedGain);
+      }
+    }
+
+    // The default is the widest supported instruction set
+    const InstructionSet best = GetBestInstructionSet();
+    if( IsSupported(InstructionSet::AVX512) )
+      EXPECT_EQ( best, InstructionSet::AVX512 );
+    else if( IsSupported(InstructionSet::AVX2) )
+      EXPECT_EQ( best, InstructionSet::AVX2 );
+    else
+      EXPECT_EQ( best, InstructionSet::Scalar );
+
+}
+
+TEST_F(FindBestCutTest, AllInstructionSetsGiveSameResult) {
+
+    EXPECT_TRUE( IsSupported(InstructionSet::Scalar) );
+    EXPECT_TRUE( IsSupported(GetBestInstructionSet()) );
+
+    // Use few different values, so that there are many cuts with the same gain,
+    // and some non-finite and negative values
+    std::srand(42);
+    for(unsigned int nCuts : {1u, 7u, 8u, 15u, 16u, 17u, 63u, 255u}) {
+      for(unsigned int iTrial = 0; iTrial < 20; ++iTrial) {
+        std::vector<Weight> CDF(2*nCuts);
+        for(unsigned int iCut = 0; iCut < nCuts; ++iCut) {
+          CDF[2*iCut] = static_cast<Weight>(std::rand() % 5) - (iTrial % 4 == 0 ? 1.0f : 0.0f);
+          CDF[2*iCut+1] = static_cast<Weight>(std::rand() % 5);
+        }
+        if(iTrial % 5 == 1)
+          CDF[2*(std::rand() % nCuts)] = std::numeric_limits<Weight>::quiet_NaN();
+        const Weight signal = 4.0;
+        const Weight bckgrd = 4.0;
+        const Weight currentLoss = LossFunction(signal, bckgrd);
+
+        Weight scalarGain = (iTrial % 3 == 2) ? 1.5 : 0.0;
+        const int scalarCut = FindBestCut(CDF.data(), nCuts, signal, bckgrd, currentLoss, scalarGain, InstructionSet::Scalar);
+        for(auto instructionSet : {InstructionSet::AVX2, InstructionSet::AVX512}) {
+          if(not IsSupported(instructionSet))
+            continue;
+          Weight gain = (iTrial % 3 == 2) ? 1.5 : 0.0;
+          EXPECT_EQ( FindBestCut(CDF.data(), nCuts, signal, bckgrd, currentLoss, gain, instructionSet), scalarCut);
+          EXPECT_EQ( gain, scalarGain);
+        }
+      }
+    }
+
+}
+
+TEST(CalculateBoostWeightsTest, AllInstructionSetsAgreeWithinTolerance) {
+
+    // Cover the typical range of F, the clamping of the exponent and special values
+    std::vector<double> F;
+    std::srand(42);
+    for(unsigned int i = 0; i < 10000; ++i)
+      F.push_back((static_cast<double>(std::rand()) / RAND_MAX - 0.5) * 40.0);
+    for(double f : {0.0, -0.0, 1e-300, 100.0, -100.0, 400.0, -400.0, 1e10, -1e10})
+      F.push_back(f);
+    F.push_back(std::numeric_limits<double>::infinity());
+    F.push_back(-std::numeric_limits<double>::infinity());
+    F.push_back(std::numeric_limits<double>::quiet_NaN());
+    const unsigned int nEvents = F.size();
+
+    for(double factor : {2.0, -2.0}) {
+      std::vector<Weight> scalarWeights(nEvents);
+      CalculateBoostWeights(F.data(), nEvents, factor, scalarWeights.data(), InstructionSet::Scalar);
+      EXPECT_FLOAT_EQ( scalarWeights[0], 2.0/(1.0+std::exp(factor*F[0])) );
+      EXPECT_TRUE( std::isnan(scalarWeights.back()) );
+      for(auto instructionSet : {InstructionSet::AVX2, InstructionSet::AVX512}) {
+        if(not IsSupported(instructionSet))
+          continue;
+        std::vector<Weight> weights(nEvents);
+        CalculateBoostWeights(F.data(), nEvents, factor, weights.data(), instructionSet);
+        for(unsigned int i = 0; i + 1 < nEvents; ++i)
+          EXPECT_NEAR( weights[i], scalarWeights[i], scalarWeights[i] * std::pow(2.0, -23) ) << "F = " << F[i];
+        EXPECT_TRUE( std::isnan(weights.back()) );
+      }
+    }
+
+}
+
 class NodeTest : public ::testing::Test {
     protected:
         virtual void SetUp() {
@@ -1283,6 +2125,228 @@ TEST_F(TreeBuilderTest, BoostWeightsOfNodesAreCorrectAfterTraining) {
 
 }
 
+TEST_F(TreeBuilderTest, BestFirstGrowthSplitsLeafWithLargestGain) {
+
+    // The right child of the root has a larger gain than the left one, see DeterminedCutsAreCorrect
+    TreeBuilder dt(2, *eventSample, 1, false, 3);
+    const auto &cuts = dt.GetCuts();
+    EXPECT_TRUE( cuts[0].valid );
+    EXPECT_FALSE( cuts[1].valid );
+    EXPECT_TRUE( cuts[2].valid );
+    EXPECT_EQ( cuts[2].feature, 1u );
+    EXPECT_EQ( cuts[2].index, 2u );
+
+    // The events of the left child stay in this node, see FlagsAreCorrectAfterTraining
+    auto &flags = eventSample->GetFlags();
+    EXPECT_EQ( flags.Get(0), 2 );
+    EXPECT_EQ( flags.Get(1), 2 );
+    EXPECT_EQ( flags.Get(2), 2 );
+    EXPECT_EQ( flags.Get(3), 6 );
+    EXPECT_EQ( flags.Get(4), 7 );
+    EXPECT_EQ( flags.Get(5), 2 );
+    EXPECT_EQ( flags.Get(6), 7 );
+    EXPECT_EQ( flags.Get(7), 6 );
+
+    const auto &nEntries = dt.GetNEntries();
+    EXPECT_FLOAT_EQ( nEntries[1], 8.0 );
+    EXPECT_FLOAT_EQ( nEntries[3], 0.0 );
+    EXPECT_FLOAT_EQ( nEntries[5], 7.0 );
+    const auto &boostWeights = dt.GetBoostWeights();
+    EXPECT_FLOAT_EQ( boostWeights[1], -1.0 );
+    EXPECT_FLOAT_EQ( boostWeights[5], 0.090909090909090912 );
+    EXPECT_FLOAT_EQ( boostWeights[6], 1.6666666666666667 );
+
+}
+
+TEST_F(TreeBuilderTest, BestFirstGrowthWithEnoughLeavesGivesCompleteTree) {
+
+    const unsigned int numberOfEvents = 2000;
+    EventSample sample(numberOfEvents, 3, 0, {3, 4, 2});
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        const bool isSignal = i % 3 == 0;
+        sample.AddEvent(std::vector<unsigned int>({(i * 5 + isSignal) % 9, (i * 7) % 17, (i % 11 == 0) ? 0 : (i % 4 + 1)}), 1.0f + 0.1f * (i % 13), isSignal);
+    }
+    std::vector<unsigned int> enabledEvents;
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        if( i % 7 >= 2 )
+            enabledEvents.push_back(i);
+    }
+
+    TreeBuilder complete(3, sample, enabledEvents, 1, true);
+    std::vector<int> flags(numberOfEvents);
+    for(unsigned int i = 0; i < numberOfEvents; ++i)
+        flags[i] = sample.GetFlags().Get(i);
+
+    TreeBuilder bestFirst(3, sample, enabledEvents, 1, true, 8);
+    for(unsigned int i = 0; i < numberOfEvents; ++i)
+        EXPECT_EQ( sample.GetFlags().Get(i), flags[i] );
+    for(unsigned int iCut = 0; iCut < complete.GetCuts().size(); ++iCut) {
+        EXPECT_EQ( complete.GetCuts()[iCut].valid, bestFirst.GetCuts()[iCut].valid );
+        EXPECT_EQ( complete.GetCuts()[iCut].feature, bestFirst.GetCuts()[iCut].feature );
+        EXPECT_EQ( complete.GetCuts()[iCut].index, bestFirst.GetCuts()[iCut].index );
+    }
+    EXPECT_EQ( complete.GetBoostWeights(), bestFirst.GetBoostWeights() );
+    EXPECT_EQ( complete.GetOutOfBagIndices(), bestFirst.GetOutOfBagIndices() );
+    EXPECT_EQ( complete.GetOutOfBagNodes(), bestFirst.GetOutOfBagNodes() );
+
+    // With a smaller budget the tree has at most the given number of leaves, and the out-of-bag events are routed like ValueToNode
+    TreeBuilder small(3, sample, enabledEvents, 1, true, 5);
+    Tree<unsigned int> tree(small.GetCuts(), small.GetNEntries(), small.GetPurities(), small.GetBoostWeights());
+    unsigned int nSplits = 0;
+    for(auto &cut : small.GetCuts())
+        nSplits += cut.valid;
+    EXPECT_EQ( nSplits, 4u );
+    const auto &indices = small.GetOutOfBagIndices();
+    for(unsigned int i = 0; i < indices.size(); ++i)
+        EXPECT_EQ( small.GetOutOfBagNodes()[i], tree.ValueToNode(sample.GetValues().GetEvent(indices[i])) );
+    for(auto &iEvent : enabledEvents)
+        EXPECT_EQ( static_cast<unsigned int>(std::abs(sample.GetFlags().Get(iEvent))) - 1, tree.ValueToNode(sample.GetValues().GetEvent(iEvent)) );
+
+}
+
+TEST_F(TreeBuilderTest, DeepTreesStoreOnlyCreatedNodes) {
+
+    const unsigned int numberOfEvents = 5000;
+    EventSample sample(numberOfEvents, 2, 0, {8, 8});
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        const unsigned int hash = (i * 2654435761u) >> 7;
+        const bool isSignal = hash % 3 == 0;
+        sample.AddEvent(std::vector<unsigned int>({(hash % 255) + 1, ((hash >> 8) % 255) + 1}), 1.0f, isSignal);
+    }
+    std::vector<unsigned int> enabledEvents;
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        if( i % 5 != 0 )
+            enabledEvents.push_back(i);
+    }
+
+    // Every node has a cut and the position of its left child, instead of all 2^20 positions of a complete tree
+    TreeBuilder dt(20, sample, enabledEvents, 1, true);
+    const auto &cuts = dt.GetCuts();
+    const auto &children = dt.GetChildren();
+    EXPECT_EQ( children.size(), cuts.size() );
+    EXPECT_EQ( dt.GetBoostWeights().size(), cuts.size() );
+    EXPECT_LT( cuts.size(), 2*enabledEvents.size() );
+    unsigned int nSplits = 0;
+    for(auto &cut : cuts)
+        nSplits += cut.valid;
+    EXPECT_EQ( cuts.size(), 2*nSplits + 1 );
+
+    // The flags and the out-of-bag nodes contain the position of the node in the compact tree
+    Tree<unsigned int> tree(cuts, dt.GetNEntries(), dt.GetPurities(), dt.GetBoostWeights(), children);
+    EXPECT_TRUE( tree.IsCompact() );
+    unsigned int maxDepth = 0;
+    for(auto &iEvent : enabledEvents) {
+        const auto &event = sample.GetValues().GetEvent(iEvent);
+        EXPECT_EQ( static_cast<unsigned int>(std::abs(sample.GetFlags().Get(iEvent))) - 1, tree.ValueToNode(event) );
+        maxDepth = std::max(maxDepth, static_cast<unsigned int>(tree.ValueToNodePath(event).size()));
+    }
+    EXPECT_GT( maxDepth, 10u );
+    EXPECT_LE( maxDepth, 20u );
+    const auto &indices = dt.GetOutOfBagIndices();
+    for(unsigned int i = 0; i < indices.size(); ++i)
+        EXPECT_EQ( dt.GetOutOfBagNodes()[i], tree.ValueToNode(sample.GetValues().GetEvent(indices[i])) );
+
+    // With a budget of leaves the deep tree is grown best-first
+    TreeBuilder bestFirst(20, sample, enabledEvents, 1, false, 12);
+    EXPECT_EQ( bestFirst.GetCuts().size(), 23u );
+    EXPECT_EQ( bestFirst.GetChildren().size(), 23u );
+
+    // Trees with at most 10 layers keep the complete layout
+    TreeBuilder shallow(10, sample, enabledEvents);
+    EXPECT_TRUE( shallow.GetChildren().empty() );
+    EXPECT_EQ( shallow.GetCuts().size(), 1023u );
+
+}
+
+TEST_F(TreeBuilderTest, ResultDoesNotDependOnNumberOfThreads) {
+
+    // Use enough events, so that the nodes of the first layers are split into several chunks
+    const unsigned int numberOfEvents = 300000;
+    std::vector<std::vector<int>> flags;
+    std::vector<std::vector<Weight>> nEntries;
+    std::vector<std::vector<Cut<unsigned int>>> cuts;
+    for(unsigned int nThreads : {1u, 3u, 8u}) {
+        EventSample sample(numberOfEvents, 3, 1, {3, 4, 2, 2}, true);
+        for(unsigned int i = 0; i < numberOfEvents; ++i) {
+            const bool isSignal = i % 3 == 0;
+            sample.AddEvent(std::vector<unsigned int>({(i * 5 + isSignal) % 9, (i * 7) % 17, (i % 11 == 0) ? 0 : (i % 4 + 1), i % 5}), 1.0f + 0.1f * (i % 13), isSignal);
+        }
+        TreeBuilder dt(3, sample, nThreads);
+        flags.push_back(std::vector<int>(numberOfEvents));
+        for(unsigned int i = 0; i < numberOfEvents; ++i)
+            flags.back()[i] = sample.GetFlags().Get(i);
+        nEntries.push_back(dt.GetNEntries());
+        cuts.push_back(dt.GetCuts());
+    }
+
+    for(unsigned int i = 1; i < flags.size(); ++i) {
+        EXPECT_EQ( flags[0], flags[i] );
+        EXPECT_EQ( nEntries[0], nEntries[i] );
+        for(unsigned int iCut = 0; iCut < cuts[0].size(); ++iCut) {
+            EXPECT_EQ( cuts[0][iCut].valid, cuts[i][iCut].valid );
+            EXPECT_EQ( cuts[0][iCut].feature, cuts[i][iCut].feature );
+            EXPECT_EQ( cuts[0][iCut].index, cuts[i][iCut].index );
+        }
+    }
+
+    EXPECT_TRUE( cuts[0][0].valid );
+    EXPECT_GT( nEntries[0][1], 0.0 );
+    EXPECT_GT( nEntries[0][2], 0.0 );
+
+}
+
+TEST_F(TreeBuilderTest, OutOfBagEventsAreRoutedLikeValueToNode) {
+
+    const unsigned int numberOfEvents = 2000;
+    EventSample sample(numberOfEvents, 3, 0, {3, 4, 2});
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        const bool isSignal = i % 3 == 0;
+        sample.AddEvent(std::vector<unsigned int>({(i * 5 + isSignal) % 9, (i * 7) % 17, (i % 11 == 0) ? 0 : (i % 4 + 1)}), 1.0f + 0.1f * (i % 13), isSignal);
+    }
+    std::vector<unsigned int> outOfBag;
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        if( i % 7 < 2 ) {
+            sample.GetFlags().Set(i, 0);
+            outOfBag.push_back(i);
+        }
+    }
+
+    TreeBuilder dt(3, sample, 1, true);
+    Tree<unsigned int> tree(dt.GetCuts(), dt.GetNEntries(), dt.GetPurities(), dt.GetBoostWeights());
+
+    auto indices = dt.GetOutOfBagIndices();
+    const auto &nodes = dt.GetOutOfBagNodes();
+    ASSERT_EQ( indices.size(), nodes.size() );
+    for(unsigned int i = 0; i < indices.size(); ++i) {
+        EXPECT_EQ( sample.GetFlags().Get(indices[i]), 0 );
+        EXPECT_EQ( nodes[i], tree.ValueToNode(sample.GetValues().GetEvent(indices[i])) );
+    }
+    std::sort(indices.begin(), indices.end());
+    EXPECT_EQ( indices, outOfBag );
+
+    // The enabled events can be given directly instead of by their flags
+    std::vector<unsigned int> enabledEvents;
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        if( i % 7 >= 2 )
+            enabledEvents.push_back(i);
+        sample.GetFlags().Set(i, -5);
+    }
+    TreeBuilder dt3(3, sample, enabledEvents, 1, true);
+    EXPECT_EQ( dt.GetNEntries(), dt3.GetNEntries() );
+    EXPECT_EQ( dt.GetOutOfBagIndices(), dt3.GetOutOfBagIndices() );
+    EXPECT_EQ( dt.GetOutOfBagNodes(), dt3.GetOutOfBagNodes() );
+    EXPECT_THROW( TreeBuilder(3, sample, std::vector<unsigned int>({2, 1})), std::runtime_error );
+    EXPECT_THROW( TreeBuilder(3, sample, std::vector<unsigned int>({1, numberOfEvents})), std::runtime_error );
+
+    // Without the option no out-of-bag events are routed, the tree is the same
+    for(unsigned int i = 0; i < numberOfEvents; ++i)
+        sample.GetFlags().Set(i, i % 7 < 2 ? 0 : 1);
+    TreeBuilder dt2(3, sample);
+    EXPECT_TRUE( dt2.GetOutOfBagIndices().empty() );
+    EXPECT_EQ( dt.GetNEntries(), dt2.GetNEntries() );
+
+}
+
 
 class TreeTest : public ::testing::Test {
     protected:
@@ -1407,6 +2471,244 @@ TEST_F(ForestBuilderTest, ForestIsCorrect) {
 
 }
 
+TEST_F(ForestBuilderTest, OutOfBagLossIsOnlyRecordedWithOutOfBagEvents) {
+
+    // With gradient-based one-side sampling of all events no event is out-of-bag
+    ForestBuilder forest(*eventSample, 5, 0.1, 0.5, 1, false, -1.0, 1, 0, false, 1.0);
+    EXPECT_EQ(forest.GetForest().size(), 5u);
+    EXPECT_TRUE(forest.GetOutOfBagLoss().empty());
+
+}
+
+TEST_F(ForestBuilderTest, FlatnessLossWorksWithManySpectators) {
+
+    // The combinations of the bins of eight spectators with 16 levels each do not fit into 64 bits,
+    // hence only the occupied uniform bins must be stored.
+    // The training modifies the weights of the sample, so every forest gets its own sample.
+    const unsigned int nSpectators = 8;
+    std::vector<unsigned int> nLevels(2 + nSpectators, 16);
+    EventSample sample1(1000, 2, nSpectators, nLevels);
+    EventSample sample2(1000, 2, nSpectators, nLevels);
+    std::vector<unsigned int> bins(2 + nSpectators);
+    for(unsigned int iEvent = 0; iEvent < 1000; ++iEvent) {
+        bool isSignal = iEvent % 2 == 0;
+        bins[0] = (iEvent * 7919) % 65536 + 1;
+        bins[1] = isSignal ? 1 + iEvent % 8 : 9 + iEvent % 8;
+        for(unsigned int iSpectator = 0; iSpectator < nSpectators; ++iSpectator)
+            bins[2 + iSpectator] = (iEvent * (iSpectator + 3) * 104729) % 65536 + 1;
+        sample1.AddEvent(bins, 1.0, isSignal);
+        sample2.AddEvent(bins, 1.0, isSignal);
+    }
+
+    ForestBuilder forest1(sample1, 5, 0.1, 1.0, 2, false, 1.0, 1);
+    ForestBuilder forest2(sample2, 5, 0.1, 1.0, 2, false, 1.0, 4);
+    ASSERT_EQ(forest1.GetForest().size(), 5u);
+    ASSERT_EQ(forest2.GetForest().size(), 5u);
+    for(unsigned int iTree = 0; iTree < 5; ++iTree)
+        EXPECT_EQ(forest1.GetForest()[iTree].GetBoostWeights(), forest2.GetForest()[iTree].GetBoostWeights());
+    EXPECT_EQ(forest1.GetForest()[0].GetCut(0).feature, 1u);
+
+}
+
+TEST_F(ForestBuilderTest, BoostWeightsFollowTheOutputOfThePreviousTrees) {
+
+    // Use enough events, so that the weights are updated in several chunks by several threads
+    const unsigned int numberOfEvents = 100000;
+    EventSample sample(numberOfEvents, 2, 0, {3, 3});
+    for(unsigned int i = 0; i < numberOfEvents; ++i) {
+        const bool isSignal = i % 3 == 0;
+        sample.AddEvent(std::vector<unsigned int>({(i * 5 + 4 * isSignal) % 8 + 1, (i * 7) % 8 + 1}), 1.0f + 0.1f * (i % 13), isSignal);
+    }
+
+    // After the training the weights are the ones of the last tree, calculated from the output F of the first tree.
+    // F0 is absorbed into the original weights, so it does not contribute to F.
+    ForestBuilder forest(sample, 2, 0.1, 1.0, 2, false, -1.0, 4);
+    ASSERT_EQ(forest.GetForest().size(), 2u);
+    const auto &tree = forest.GetForest()[0];
+    const auto &values = sample.GetValues();
+    const auto &weights = sample.GetWeights();
+    for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+        const double F = forest.GetShrinkage() * tree.GetBoostWeight(tree.ValueToNode(values.GetEvent(iEvent)));
+        const double factor = sample.IsSignal(iEvent) ? 2.0 : -2.0;
+        const double expected = 2.0 / (1.0 + std::exp(factor * F));
+        EXPECT_NEAR( weights.GetWithoutOriginal(iEvent), expected, expected * std::pow(2.0, -23) );
+    }
+
+}
+
+TEST_F(ForestBuilderTest, SubsampleIsDeterminedBySeed) {
+
+    // Use enough events, so that the subsample is drawn in several chunks by several threads
+    const unsigned int numberOfEvents = 200000;
+    auto drawSubsample = [&](unsigned int seed, unsigned int nThreads, unsigned int nTrees) {
+        EventSample sample(numberOfEvents, 1, 0, {2});
+        for(unsigned int i = 0; i < numberOfEvents; ++i)
+            sample.AddEvent(std::vector<unsigned int>({i % 4 + 1}), 1.0, i % 2 == 0);
+        ForestBuilder forest(sample, nTrees, 0.1, 0.5, 1, false, -1.0, nThreads, seed);
+        return forest.GetSubsample();
+    };
+
+    const auto subsample = drawSubsample(42, 1, 1);
+    EXPECT_NEAR( subsample.size(), 0.5 * numberOfEvents, 0.01 * numberOfEvents );
+    for(unsigned int i = 1; i < subsample.size(); ++i)
+        EXPECT_LT( subsample[i-1], subsample[i] );
+    EXPECT_LT( subsample.back(), numberOfEvents );
+
+    // The same seed draws the same events, independent of the number of threads,
+    // another seed or another tree draws different events
+    EXPECT_EQ( subsample, drawSubsample(42, 1, 1) );
+    EXPECT_EQ( subsample, drawSubsample(42, 4, 1) );
+    EXPECT_NE( subsample, drawSubsample(43, 1, 1) );
+    EXPECT_NE( subsample, drawSubsample(42, 1, 2) );
+
+    // The events are drawn independently, so about half of the events of each half of the sample are drawn
+    const auto middle = std::lower_bound(subsample.begin(), subsample.end(), numberOfEvents / 2);
+    EXPECT_NEAR( middle - subsample.begin(), 0.25 * numberOfEvents, 0.01 * numberOfEvents );
+
+    // Without subsampling every event is used
+    EventSample sample(100, 1, 0, {2});
+    for(unsigned int i = 0; i < 100; ++i)
+        sample.AddEvent(std::vector<unsigned int>({i % 4 + 1}), 1.0, i % 2 == 0);
+    ForestBuilder forest(sample, 1, 0.1, 1.0, 1, false, -1.0, 1, 42);
+    EXPECT_EQ( forest.GetSubsample().size(), 100u );
+
+}
+
+TEST_F(ForestBuilderTest, StratifiedSubsampleContainsExactFractions) {
+
+    // 333 signal and 667 background events, so 30% are 100 signal and 200 background events
+    const unsigned int numberOfEvents = 1000;
+    for(bool sPlot : {false, true}) {
+      for(unsigned int seed : {1u, 2u, 3u}) {
+        EventSample sample(numberOfEvents, 1, 0, {2});
+        for(unsigned int i = 0; i < numberOfEvents; ++i)
+            sample.AddEvent(std::vector<unsigned int>({i % 4 + 1}), 1.0, i % 3 == 0);
+        ForestBuilder forest(sample, 1, 0.1, 0.3, 1, sPlot, -1.0, 1, seed, true);
+        const auto &subsample = forest.GetSubsample();
+
+        std::vector<bool> drawn(numberOfEvents, false);
+        unsigned int nSignals = 0;
+        for(auto iEvent : subsample) {
+            ASSERT_LT( iEvent, numberOfEvents );
+            EXPECT_FALSE( drawn[iEvent] );
+            drawn[iEvent] = true;
+            nSignals += sample.IsSignal(iEvent) ? 1 : 0;
+        }
+
+        if( sPlot ) {
+            // The pairs of the events i and nEvents - i - 1 are drawn together, 30% of the 500 pairs
+            EXPECT_EQ( subsample.size(), 300u );
+            for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent)
+                EXPECT_EQ( drawn[iEvent], drawn[numberOfEvents - iEvent - 1] );
+        } else {
+            EXPECT_EQ( nSignals, 100u );
+            EXPECT_EQ( subsample.size() - nSignals, 200u );
+            EXPECT_TRUE( std::is_sorted(subsample.begin(), subsample.end()) );
+        }
+      }
+    }
+
+}
+
+TEST_F(ForestBuilderTest, GOSSAlwaysUsesEventsWithLargestWeights) {
+
+    // Half of the events are signal, so F0 is 0 and the original weights stay 1
+    const unsigned int numberOfEvents = 1000;
+    const unsigned int nTop = 200;
+    for(bool stratified : {false, true}) {
+        EventSample sample(numberOfEvents, 2, 0, {3, 3});
+        for(unsigned int i = 0; i < numberOfEvents; ++i) {
+            const bool isSignal = i % 2 == 0;
+            sample.AddEvent(std::vector<unsigned int>({(i * 5 + 3 * isSignal) % 8 + 1, (i * 7) % 8 + 1}), 1.0, isSignal);
+        }
+        ForestBuilder forest(sample, 3, 0.1, 0.1, 2, false, -1.0, 1, 42, stratified, 0.2);
+        ASSERT_EQ( forest.GetForest().size(), 3u );
+        const auto &subsample = forest.GetSubsample();
+        const auto &weights = sample.GetWeights();
+
+        // The subsample of the last tree was drawn with the current boosting weights, every event with
+        // a larger weight than the 200th largest weight is used, and ties with it fill up the top events
+        std::vector<Weight> sortedWeights;
+        for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent)
+            sortedWeights.push_back(std::abs(weights.GetWithoutOriginal(iEvent)));
+        std::sort(sortedWeights.begin(), sortedWeights.end(), std::greater<Weight>());
+        const Weight threshold = sortedWeights[nTop - 1];
+        ASSERT_GT( sortedWeights.front(), sortedWeights.back() );
+        std::vector<bool> drawn(numberOfEvents, false);
+        for(auto iEvent : subsample)
+            drawn[iEvent] = true;
+        unsigned int nDrawnAboveThreshold = 0;
+        for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent) {
+            const Weight weight = std::abs(weights.GetWithoutOriginal(iEvent));
+            if( weight > threshold ) {
+                EXPECT_TRUE( drawn[iEvent] );
+            }
+            if( weight >= threshold and drawn[iEvent] )
+                ++nDrawnAboveThreshold;
+        }
+        EXPECT_GE( nDrawnAboveThreshold, nTop );
+
+        // 10% of the remaining 800 events are drawn, with stratification exactly 10% of the remaining signal
+        // and background events, which differ from 400 depending on the composition of the largest weights
+        if( stratified ) {
+            EXPECT_NEAR( subsample.size(), nTop + 80u, 1u );
+        } else {
+            EXPECT_NEAR( subsample.size(), nTop + 80u, 30u );
+        }
+
+        // The scaling of the drawn weights is undone after every tree
+        for(unsigned int iEvent = 0; iEvent < numberOfEvents; ++iEvent)
+            EXPECT_EQ( weights.GetOriginal(iEvent), 1.0 );
+    }
+
+}
+
+TEST_F(ForestBuilderTest, BestFirstTreesHaveMaximumNumberOfLeaves) {
+
+    // Counts the leaves reachable from the root, in the complete layout the children of node n are 2n and 2n + 1
+    auto countLeaves = [](const Tree<unsigned int> &tree) {
+        const auto &cuts = tree.GetCuts();
+        const auto &children = tree.GetChildren();
+        unsigned int nLeaves = 0;
+        std::vector<unsigned int> nodes = {tree.IsCompact() ? 0u : 1u};
+        while( not nodes.empty() ) {
+            const unsigned int node = nodes.back();
+            nodes.pop_back();
+            const unsigned int iCut = tree.IsCompact() ? node : node - 1;
+            if( iCut >= cuts.size() or not cuts[iCut].valid ) {
+                ++nLeaves;
+            } else if( tree.IsCompact() ) {
+                nodes.push_back(children[node]);
+                nodes.push_back(children[node] + 1);
+            } else {
+                nodes.push_back(2*node);
+                nodes.push_back(2*node + 1);
+            }
+        }
+        return nLeaves;
+    };
+
+    const unsigned int numberOfEvents = 2000;
+    for(unsigned int maxLeaves : {0u, 2u, 5u, 12u}) {
+        EventSample sample(numberOfEvents, 3, 0, {3, 4, 2});
+        for(unsigned int i = 0; i < numberOfEvents; ++i) {
+            const bool isSignal = i % 3 == 0;
+            sample.AddEvent(std::vector<unsigned int>({(i * 5 + 4 * isSignal) % 8 + 1, (i * 7 + isSignal) % 16 + 1, i % 4 + 1}), 1.0f + 0.1f * (i % 13), isSignal);
+        }
+        ForestBuilder forest(sample, 5, 0.1, 1.0, 6, false, -1.0, 1, 0, false, 0.0, maxLeaves);
+        ASSERT_EQ( forest.GetForest().size(), 5u );
+        for(auto &tree : forest.GetForest()) {
+            // Without a limit the complete tree with 6 layers has up to 64 leaves
+            if( maxLeaves == 0 ) {
+                EXPECT_GT( countLeaves(tree), 12u );
+            } else {
+                EXPECT_EQ( countLeaves(tree), maxLeaves );
+            }
+        }
+    }
+
+}
+
 class ForestTest : public ::testing::Test {
     protected:
         virtual void SetUp() {
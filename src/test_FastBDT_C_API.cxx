@@ -40,6 +40,17 @@ TEST_F(CInterfaceTest, SetGetPurityTransformation ) {
 
 }
 
+TEST_F(CInterfaceTest, SetGetBinningStrategy ) {
+    
+    unsigned int binningStrategy[] = {2, 0, 1};
+    SetBinningStrategy(expertise, binningStrategy, 3);
+    EXPECT_EQ(expertise->classifier.GetBinningStrategy().size(), 3u);
+    EXPECT_EQ(expertise->classifier.GetBinningStrategy()[0], FastBDT::BinningStrategy::Equidistant);
+    EXPECT_EQ(expertise->classifier.GetBinningStrategy()[1], FastBDT::BinningStrategy::Quantile);
+    EXPECT_EQ(expertise->classifier.GetBinningStrategy()[2], FastBDT::BinningStrategy::Weighted);
+
+}
+
 TEST_F(CInterfaceTest, SetGetNTrees ) {
     
     SetNTrees(expertise, 200u);
@@ -74,6 +85,70 @@ TEST_F(CInterfaceTest, SetGetDepth ) {
 
 }
 
+TEST_F(CInterfaceTest, SetGetNThreads ) {
+    
+    SetNThreads(expertise, 4u);
+    EXPECT_EQ(expertise->classifier.GetNThreads(), 4u);
+    EXPECT_EQ(GetNThreads(expertise), 4u);
+
+}
+
+TEST_F(CInterfaceTest, SetGetColumnMajor ) {
+    
+    SetColumnMajor(expertise, true);
+    EXPECT_EQ(expertise->classifier.GetColumnMajor(), true);
+    EXPECT_EQ(GetColumnMajor(expertise), true);
+
+}
+
+TEST_F(CInterfaceTest, SetGetHistogramTileSize ) {
+    
+    SetHistogramTileSize(expertise, 4096u);
+    EXPECT_EQ(expertise->classifier.GetHistogramTileSize(), 4096u);
+    EXPECT_EQ(GetHistogramTileSize(expertise), 4096u);
+
+}
+
+TEST_F(CInterfaceTest, SetGetSeed ) {
+    
+    SetSeed(expertise, 1234u);
+    EXPECT_EQ(expertise->classifier.GetSeed(), 1234u);
+    EXPECT_EQ(GetSeed(expertise), 1234u);
+
+}
+
+TEST_F(CInterfaceTest, SetGetStratifiedSubsample ) {
+    
+    SetStratifiedSubsample(expertise, true);
+    EXPECT_EQ(expertise->classifier.GetStratifiedSubsample(), true);
+    EXPECT_EQ(GetStratifiedSubsample(expertise), true);
+
+}
+
+TEST_F(CInterfaceTest, SetGetGOSSTopFraction ) {
+    
+    SetGOSSTopFraction(expertise, 0.2);
+    EXPECT_DOUBLE_EQ(expertise->classifier.GetGOSSTopFraction(), 0.2);
+    EXPECT_DOUBLE_EQ(GetGOSSTopFraction(expertise), 0.2);
+
+}
+
+TEST_F(CInterfaceTest, SetGetAggregateDuplicates ) {
+    
+    SetAggregateDuplicates(expertise, true);
+    EXPECT_EQ(expertise->classifier.GetAggregateDuplicates(), true);
+    EXPECT_EQ(GetAggregateDuplicates(expertise), true);
+
+}
+
+TEST_F(CInterfaceTest, SetGetMaxLeaves ) {
+    
+    SetMaxLeaves(expertise, 12);
+    EXPECT_EQ(expertise->classifier.GetMaxLeaves(), 12u);
+    EXPECT_EQ(GetMaxLeaves(expertise), 12u);
+
+}
+
 TEST_F(CInterfaceTest, SetGetFlatnessLossWorks ) {
     
     SetFlatnessLoss(expertise, 0.2);
@@ -287,6 +287,73 @@ TEST_F(IOTest, IOTree) {
 
 }
 
+TEST_F(IOTest, IOCompactTree) {
+
+    Cut<unsigned int> cut1, cut2, leaf;
+    cut1.feature = 0;
+    cut1.index = 5;
+    cut1.valid = true;
+    cut1.gain = -3.0;
+    cut2.feature = 1;
+    cut2.index = 9;
+    cut2.gain = 1.0;
+    cut2.valid = true;
+
+    std::vector<Cut<unsigned int>> before_cuts = {cut1, leaf, cut2, leaf, leaf};
+    std::vector<Weight> before_nEntries = { 10.0, 11.0, 12.0, 13.0, 14.0 };
+    std::vector<Weight> before_purities = { 0.1, 0.2, 0.3, 0.4, 0.5 };
+    std::vector<Weight> before_boostWeights = { 1.0, 2.0, 3.0, 4.0, 5.0 };
+    std::vector<unsigned int> before_children = { 1, 0, 3, 0, 0 };
+    Tree<unsigned int> before(before_cuts, before_nEntries, before_purities, before_boostWeights, before_children);
+
+    std::stringstream stream;
+    stream << before;
+
+    auto after = readTreeFromStream<unsigned int>(stream);
+    EXPECT_TRUE(after.IsCompact());
+    EXPECT_EQ(before_children, after.GetChildren());
+    EXPECT_EQ(before_boostWeights, after.GetBoostWeights());
+    EXPECT_EQ(before_cuts.size(), after.GetCuts().size());
+    for(unsigned int i = 0; i < before_cuts.size() and i < after.GetCuts().size(); ++i) {
+        EXPECT_EQ(before_cuts[i].feature, after.GetCuts()[i].feature);
+        EXPECT_EQ(before_cuts[i].valid, after.GetCuts()[i].valid);
+        EXPECT_EQ(before_cuts[i].index, after.GetCuts()[i].index);
+    }
+
+    // The left child of the root is a leaf, the right child is split again
+    EXPECT_EQ(after.ValueToNode(std::vector<unsigned int>({4, 9})), 1u);
+    EXPECT_EQ(after.ValueToNode(std::vector<unsigned int>({5, 8})), 3u);
+    EXPECT_EQ(after.ValueToNode(std::vector<unsigned int>({5, 9})), 4u);
+    EXPECT_EQ(after.ValueToNode(std::vector<unsigned int>({5, 0})), 2u);
+
+    // A complete tree written afterwards to the same stream is still read correctly
+    Tree<unsigned int> complete({cut1}, {1.0, 2.0, 3.0}, {0.1, 0.2, 0.3}, {1.0, 2.0, 3.0});
+    stream << complete;
+    EXPECT_FALSE(readTreeFromStream<unsigned int>(stream).IsCompact());
+
+}
+
+TEST_F(IOTest, IOTreeWithoutLayout) {
+
+    // Trees written before the layout flag was added are complete, a following tree starts directly after the entries
+    std::stringstream stream;
+    stream << "1\n0\n5\n1\n-3\n" << "3 1 2 3\n" << "3 0.1 0.2 0.3\n" << "3 10 11 12\n";
+    stream << "0\n" << "1 4\n" << "1 0.4\n" << "1 13\n";
+
+    auto first = readTreeFromStream<unsigned int>(stream, false);
+    EXPECT_FALSE(first.IsCompact());
+    EXPECT_EQ(first.GetCuts().size(), 1u);
+    EXPECT_EQ(first.GetCuts()[0].index, 5u);
+    EXPECT_EQ(first.GetBoostWeights(), std::vector<Weight>({1.0, 2.0, 3.0}));
+    EXPECT_EQ(first.ValueToNode(std::vector<unsigned int>({6})), 2u);
+
+    auto second = readTreeFromStream<unsigned int>(stream, false);
+    EXPECT_FALSE(second.IsCompact());
+    EXPECT_TRUE(second.GetCuts().empty());
+    EXPECT_EQ(second.GetBoostWeights(), std::vector<Weight>({4.0}));
+
+}
+
 TEST_F(IOTest, IOForest) {
 
     Cut<unsigned int> cut1, cut2, cut3, cut4;
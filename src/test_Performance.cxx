@@ -33,10 +33,6 @@ class PerformanceFeatureBinningTest : public ::testing::Test {
 
 TEST_F(PerformanceFeatureBinningTest, FeatureBinningScalesLinearInNumberOfDataPoints) {
 
-    // This is dominated by the sorting of the numbers -> N log (N),
-    // for our purposes we assume just N, which seems to be fine
-    // if this unittest starts failing I have to revise this and add the factor of log(N)
-
     std::vector<unsigned int> sizes = {1000, 10000, 100000, 1000000};
     std::vector<double> times;
 
@@ -64,17 +60,25 @@ TEST_F(PerformanceFeatureBinningTest, FeatureBinningScalesLinearInNumberOfDataPo
 }
 
 
-TEST_F(PerformanceFeatureBinningTest, FeatureBinningScalesConstantInSmallNumberOfLayers) {
+TEST_F(PerformanceFeatureBinningTest, FeatureBinningScalesAtMostLikeSortingInSmallNumberOfLayers) {
 
-    // The feature binning should be dominated by the sorting of the numbers
-    // hence it does not scale with the number of layers to first order
-    // for large layers this will be wrong ~ #Layer > 17
+    // The feature binning used to be dominated by the sorting of the numbers, hence it did not scale
+    // with the number of layers. Now only the quantiles are selected layer by layer, so the cost grows
+    // linear with the number of layers, but for small numbers of layers (up to 17) it stays below the cost of the sorting.
     std::vector<unsigned int> sizes = {2, 3, 5, 7, 11, 13, 17};
     std::vector<double> times;
 
+    std::vector<float> sorted_data(data);
+    std::chrono::high_resolution_clock::time_point sort_start = std::chrono::high_resolution_clock::now();
+    std::sort(sorted_data.begin(), sorted_data.end(), compareIncludingNaN<float>);
+    std::chrono::high_resolution_clock::time_point sort_stop = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::micro> sort_time = sort_stop - sort_start;
+
     for( auto &size : sizes ) {
+      // Every binning gets the unsorted numbers, like the sorting above
+      std::vector<float> temp_data(data);
       std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
-      FeatureBinning<float> binning(size, data);
+      FeatureBinning<float> binning(size, temp_data);
       std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
 
       // We check something simple, so that we are sure that the compiler cannot optimize out the binning itself
@@ -84,12 +88,19 @@ TEST_F(PerformanceFeatureBinningTest, FeatureBinningScalesConstantInSmallNumberO
       times.push_back(time.count());
     }
 
+    // Check that the binning is not more expensive than the sorting, with the same tolerance as before
+    for(unsigned int i = 0; i < sizes.size(); ++i) {
+      double time_ratio = times[i] / sort_time.count();
+      EXPECT_LT(time_ratio,  1.2);
+    }
+
     // Check linear behaviour
     // We ignore the first measurement, to avoids effects of caching
     for(unsigned int i = 2; i < sizes.size(); ++i) {
+      double size_ratio = sizes[i] / static_cast<double>(sizes[1]);
       double time_ratio = times[i] / static_cast<double>(times[1]);
-      EXPECT_GT(time_ratio,  0.8);
-      EXPECT_LT(time_ratio,  1.2);
+      // We allow for deviation of factor two
+      EXPECT_LT(time_ratio,  size_ratio * 2.0);
     }
 
 }
@@ -223,8 +234,14 @@ TEST_F(PerformanceTreeBuilderTest, TreeBuilderScalesLinearForSmallNumberOfLayers
       std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
 
       // We check something simple, so that we are sure that the compiler cannot optimize out the binning itself
+      // Trees with more than 10 layers only store the nodes which were created, see TreeBuilder::GetChildren
       const auto &purities = dt.GetPurities();
-      EXPECT_EQ(purities.size(), static_cast<unsigned int>((1 << (nLayers+1)) - 1));
+      if( nLayers > 10 ) {
+        EXPECT_EQ(purities.size(), dt.GetChildren().size());
+        EXPECT_EQ(purities.size() % 2, 1u);
+      } else {
+        EXPECT_EQ(purities.size(), static_cast<unsigned int>((1 << (nLayers+1)) - 1));
+      }
 
       std::chrono::duration<double, std::micro> time = stop - start;
       times.push_back(time.count());